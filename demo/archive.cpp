@@ -0,0 +1,92 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "../dyng/dyng.h"
+
+#include <iostream>
+#include <fstream>
+#include <string> // std::stoi
+
+namespace {
+
+void usage(const char* name) {
+    std::cerr << "wrong arguments, usage:\n"
+            << "\t" << name << " pack [file] (text/binary=binary) (chunk size=64)\n"
+            << "\t" << name << " extract [file] (first state) (last state)\n";
+}
+
+int pack(const std::string& file, dyng::encoding enc, unsigned chunk_size) {
+    dyng::dynamic_graph dgraph;
+    std::cin >> dgraph;
+    std::ofstream out(file, std::ios::binary);
+    if (!out) {
+        std::cerr << "ERROR: could not open '" << file << "'\n";
+        return 1;
+    }
+    dyng::archive_writer(enc, chunk_size).write(out, dgraph);
+    return 0;
+}
+
+int extract(const std::string& file, int first, int last) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        std::cerr << "ERROR: could not open '" << file << "'\n";
+        return 1;
+    }
+    dyng::archive_reader reader(in);
+    // extracted graphs have positions on the canvas even if the archive is quantized
+    reader.set_restore_positions(true);
+    if (last < 0) {
+        last = reader.state_count();
+    }
+    dyng::dynamic_graph dgraph;
+    reader.load(dgraph, first, last);
+    std::cout << dgraph;
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string command = argv[1];
+    try {
+        if (command == "pack" && argc <= 5) {
+            dyng::encoding enc = dyng::encoding::binary;
+            if (argc > 3) {
+                std::string name = argv[3];
+                if (name != "text" && name != "binary") {
+                    usage(argv[0]);
+                    return 1;
+                }
+                enc = name == "text" ? dyng::encoding::text : dyng::encoding::binary;
+            }
+            return pack(argv[2], enc, argc > 4 ? std::stoi(argv[4]) : 64);
+        }
+        if (command == "extract" && argc <= 5) {
+            return extract(argv[2],
+                    argc > 3 ? std::stoi(argv[3]) : 0,
+                    argc > 4 ? std::stoi(argv[4]) : -1);
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "ERROR: " << ex.what() << std::endl;
+        return 1;
+    }
+    usage(argv[0]);
+    return 1;
+}
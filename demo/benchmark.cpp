@@ -15,99 +15,197 @@
 */
 #include "../dyng/dyng.h"
 #include "headers/examples.h"
+#include "headers/bench_harness.h"
+#include "headers/bench_report.h"
 
-#include <chrono>
 #include <iostream>
 #include <iomanip> // std::setw, std::fixed, std::setprecision
 #include <string> // std::stoi
+#include <vector>
+#include <functional>
 
-void header(int w) {
-    std::cout << std::setw(w) << "size" << " | "
-            << std::setw(w) << "nodes" << " | "
-            << std::setw(w) << "edges" << " | "
-            << std::setw(w) << "d=0" << " | "
-            << std::setw(w) << "d>0" << " | "
-            << std::setw(w) << "par d>0" << " | "
-            <<"\n";
-    for (int i = 0; i < 6; ++i) {
-        for (int k = 0; k < w; ++k) {
-            std::cout << "-";
-        }
-        std::cout << "-+-";
+// one measured combination of input and thread count
+struct scaling_row {
+    std::string generator;
+    unsigned size;
+    unsigned nodes;
+    unsigned edges;
+    unsigned threads;
+    // median time of the sequential layout with the same tolerance
+    double serial;
+    demo::bench_result result;
+    double speedup;
+    double efficiency;
+    // quality of the parallel layout, the same for every thread count
+    dyng::layout_quality quality;
+};
+
+void print_table(const std::vector<scaling_row>& rows) {
+    int w = 10;
+    std::vector<std::string> columns{ "generator", "size", "nodes", "edges", "threads",
+            "serial", "parallel", "p90", "speedup", "efficiency",
+            "crossings", "stress", "distance" };
+    for (const auto& c : columns) {
+        std::cout << std::setw(w + (&c == &columns.front() ? 4 : 0)) << c << " | ";
+    }
+    std::cout << "\n" << std::string(columns.size() * (w + 3) + 4, '-') << "\n";
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto& r : rows) {
+        std::cout << std::setw(w + 4) << r.generator << " | "
+                << std::setw(w) << r.size << " | "
+                << std::setw(w) << r.nodes << " | "
+                << std::setw(w) << r.edges << " | "
+                << std::setw(w) << r.threads << " | "
+                << std::setw(w - 1) << r.serial << "s | "
+                << std::setw(w - 1) << r.result.median() << "s | "
+                << std::setw(w - 1) << r.result.percentile(0.9) << "s | "
+                << std::setw(w) << r.speedup << " | "
+                << std::setw(w) << r.efficiency << " | "
+                << std::setw(w) << r.quality.crossings << " | "
+                << std::setw(w) << r.quality.stress << " | "
+                << std::setw(w) << r.quality.mean_mental_distance << " |\n";
     }
-    std::cout << std::endl;
+    std::cout << std::flush;
 }
 
-template<typename Layouter>
-float measure_time(dyng::dynamic_graph graph, Layouter& layout, bool tolerance = false) {
-    using clock = std::chrono::steady_clock;
-    layout.set_tolerance(tolerance ? 0.1 : 0);
-    clock::time_point start = clock::now();
-    layout(graph);
-    clock::time_point now = clock::now();
-
-    // force compiler to not optimize out any calculations when using -O2
-    volatile auto deoptimizer = graph;
+void print_csv(const std::vector<scaling_row>& rows, const demo::machine_info& info) {
+    std::cout << "# cores: " << info.cores << "\n"
+            << "# cpu: " << info.cpu << "\n"
+            << "# compiler: " << info.compiler << "\n"
+            << "# flags: " << info.flags << "\n"
+            << "generator,size,nodes,edges,threads,serial,median,p10,p90,speedup,efficiency,"
+            << "crossings,overlaps,stress,edge_length_variance,mean_distance,max_distance\n";
+    std::cout << std::setprecision(6);
+    for (const auto& r : rows) {
+        std::cout << r.generator << "," << r.size << "," << r.nodes << "," << r.edges << ","
+                << r.threads << "," << r.serial << "," << r.result.median() << ","
+                << r.result.percentile(0.1) << "," << r.result.percentile(0.9) << ","
+                << r.speedup << "," << r.efficiency << ","
+                << r.quality.crossings << "," << r.quality.overlaps << ","
+                << r.quality.stress << "," << r.quality.edge_length_variance << ","
+                << r.quality.mean_mental_distance << "," << r.quality.max_mental_distance << "\n";
+    }
+    std::cout << std::flush;
+}
 
-    auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
-    return us / 1000000.0f;
+void print_json(const std::vector<scaling_row>& rows, const demo::machine_info& info) {
+    std::cout << std::setprecision(6);
+    std::cout << "{\n  \"machine\": ";
+    demo::write_json(std::cout, info);
+    std::cout << ",\n  \"results\": [";
+    for (unsigned i = 0; i < rows.size(); ++i) {
+        const auto& r = rows[i];
+        std::cout << (i == 0 ? "\n" : ",\n")
+                << "    { \"generator\": " << demo::json_string(r.generator)
+                << ", \"size\": " << r.size
+                << ", \"nodes\": " << r.nodes
+                << ", \"edges\": " << r.edges
+                << ", \"threads\": " << r.threads
+                << ", \"serial\": " << r.serial
+                << ", \"median\": " << r.result.median()
+                << ", \"p10\": " << r.result.percentile(0.1)
+                << ", \"p90\": " << r.result.percentile(0.9)
+                << ", \"speedup\": " << r.speedup
+                << ", \"efficiency\": " << r.efficiency
+                << ", \"quality\": { \"crossings\": " << r.quality.crossings
+                << ", \"overlaps\": " << r.quality.overlaps
+                << ", \"stress\": " << r.quality.stress
+                << ", \"edge_length_variance\": " << r.quality.edge_length_variance
+                << ", \"mean_distance\": " << r.quality.mean_mental_distance
+                << ", \"max_distance\": " << r.quality.max_mental_distance << " } }";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
 }
 
 int main(int argc, char** argv) {
     int repeat = 1;
     int threads = 4;
-    std::vector<int> sizes{ 4, 8, 16, 24, 32, 40, 48, 56, 64, 72, 80 };
-
-    auto error = [&](){
-        std::cerr << "wrong arguments\n"
-                << "usage: " << argv[0] << " (iterations=1) (threads=4)\n";
+    std::string format = "table";
+    std::vector<unsigned> sizes{ 8, 16, 24, 32, 40 };
+    std::vector<std::pair<std::string, std::function<dyng::dynamic_graph(unsigned)>>> generators{
+        { "grid", [](unsigned size){ return demo::generate<demo::grid_generator>(size); } },
+        { "triangle", [](unsigned size){ return demo::generate<demo::triangle_grid_generator>(size); } },
     };
-    if (argc > 3) {
-        error();
-        return 1;
-    }
-    if (argc == 2) {
-        try {
+
+    try {
+        if (argc > 4) {
+            throw std::invalid_argument("too many arguments");
+        }
+        if (argc > 1) {
             repeat = std::stoi(argv[1]);
-        } catch (const std::exception& ex) {
-            error();
-            return 1;
         }
-    } else if (argc == 3) {
-        try {
+        if (argc > 2) {
             threads = std::stoi(argv[2]);
-        } catch (const std::exception& ex) {
-            error();
-            return 1;
         }
+        if (argc > 3) {
+            format = argv[3];
+        }
+        if (repeat < 1 || threads < 1
+                || (format != "table" && format != "json" && format != "csv")) {
+            throw std::invalid_argument("invalid value");
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "wrong arguments\n"
+                << "usage: " << argv[0] << " (iterations=1) (max threads=4) (format=table|json|csv)\n";
+        return 1;
+    }
+
+    const float tolerance = 0.1;
+    // nodes closer than this fraction of the canvas are counted as overlapping
+    const float overlap = 0.001;
+    demo::bench_harness harness(repeat, 0);
+    demo::machine_info info = demo::machine_info::current();
+    if (format == "table") {
+        std::cout << "iterations: " << repeat << "\n"
+                << "threads: 1.." << threads << "\n"
+                << "cores: " << info.cores << "\n"
+                << "compiler: " << info.compiler << "\n" << std::endl;
     }
 
-    int w = 8;
-    std::cout << "iterations: " << repeat << "\n"
-            << "threads: " << threads << std::endl;
-    header(w);
+    std::vector<scaling_row> rows;
+    for (const auto& gen : generators) {
+        for (unsigned size : sizes) {
+            dyng::dynamic_graph graph = gen.second(size);
+            dyng::dynamic_graph copy;
+            auto reset = [&](){ copy = graph; };
 
-    std::cout << std::fixed << std::setprecision(2);
+            dyng::default_layout serial(tolerance, 1, 1);
+            double serial_time = harness.run("serial", size, 1, reset, [&](){
+                serial(copy);
+            }).median();
 
-    dyng::default_layout layout;
-    dyng::default_layout_parallel layout_par(threads, 0.0);
-    for (int size : sizes) {
-        float notol_total = 0;
-        float tol_total = 0;
-        float par_tol_total = 0;
-        dyng::dynamic_graph graph = demo::generate<demo::grid_generator>(size);
-        for (int i = 0; i < repeat; ++i) {
-            notol_total += measure_time(graph, layout, false);
-            tol_total += measure_time(graph, layout, true);
-            par_tol_total += measure_time(graph, layout_par, true);
+            double single = 0;
+            dyng::layout_quality quality;
+            for (int t = 1; t <= threads; ++t) {
+                dyng::default_layout_parallel layout(t, tolerance);
+                scaling_row row;
+                row.generator = gen.first;
+                row.size = size;
+                row.nodes = graph.node_count();
+                row.edges = graph.edge_count();
+                row.threads = t;
+                row.serial = serial_time;
+                row.result = harness.run("parallel", size, 1, reset, [&](){
+                    layout(copy);
+                });
+                if (t == 1) {
+                    single = row.result.median();
+                    quality = dyng::measure_quality(copy, overlap);
+                }
+                row.quality = quality;
+                row.speedup = row.result.median() > 0 ? single / row.result.median() : 0;
+                row.efficiency = row.speedup / t;
+                rows.push_back(row);
+            }
         }
-        std::cout << std::setw(w) << size << " | "
-                << std::setw(w) << graph.node_count() << " | "
-                << std::setw(w) << graph.edge_count() << " | "
-                << std::setw(w - 1) << notol_total / static_cast<float>(repeat) << "s" << " | "
-                << std::setw(w - 1) << tol_total / static_cast<float>(repeat) << "s" << " | "
-                << std::setw(w - 1) << par_tol_total / static_cast<float>(repeat) << "s" << " | "
-                << std::endl;
+    }
+
+    if (format == "json") {
+        print_json(rows, info);
+    } else if (format == "csv") {
+        print_csv(rows, info);
+    } else {
+        print_table(rows);
     }
     return 0;
 }
@@ -0,0 +1,185 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "../dyng/dyng.h"
+
+#include <iostream>
+#include <iomanip> // std::setw, std::setprecision
+#include <fstream>
+#include <string> // std::stof
+#include <chrono>
+#include <algorithm> // std::min
+
+using traced_layout = dyng::foresighted_layout<
+        dyng::fruchterman_reingold<dyng::initial_placement, dyng::convergence_recorder>,
+        dyng::convergence_recorder>;
+
+// the three cooling schedules of the layout
+struct schedules {
+    dyng::cooling first;
+    dyng::cooling second;
+    dyng::cooling tolerance;
+};
+
+struct run_result {
+    // energies after the last iteration of the static layout and of tolerance
+    double static_energy;
+    double tolerance_energy;
+    double mean_distance;
+    double seconds;
+    dyng::convergence_recorder trace;
+};
+
+run_result run(const dyng::dynamic_graph& input, float tolerance, const schedules& s) {
+    run_result result;
+    traced_layout layout(tolerance, 1, 1);
+    layout.set_observer(result.trace);
+    layout.static_layout().set_observer(result.trace);
+    layout.static_layout().set_first_cooling(s.first);
+    layout.static_layout().set_second_cooling(s.second);
+    layout.set_cooling(s.tolerance);
+    dyng::dynamic_graph dgraph = input;
+    auto start = std::chrono::steady_clock::now();
+    layout(dgraph);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    auto second = result.trace.rows(dyng::layout_phase::static_pass, 1);
+    auto rounds = result.trace.rows(dyng::layout_phase::tolerance_round);
+    result.static_energy = second.empty() ? 0 : second.back().energy;
+    result.tolerance_energy = rounds.empty() ? 0 : rounds.back().energy;
+    result.mean_distance = dyng::measure_quality(dgraph, 0).mean_mental_distance;
+    return result;
+}
+
+void print_cooling(const std::string& name, const dyng::cooling& c) {
+    float end = c.start_temperature;
+    for (unsigned i = 0; i < c.iterations; ++i) {
+        end = c.anneal(end);
+    }
+    std::cout << std::setw(12) << name << ": " << std::setw(4) << c.iterations
+            << " iterations from " << c.start_temperature << " to " << end;
+    if (c.iterations > 0 && c.start_temperature > 0) {
+        std::cout << " (factor " << std::pow(end / c.start_temperature, 1.0f / c.iterations) << ")";
+    }
+    std::cout << "\n";
+}
+
+void print_run(const std::string& name, const run_result& r) {
+    std::cout << std::setw(12) << name << ": static energy " << r.static_energy
+            << ", tolerance energy " << r.tolerance_energy
+            << ", mean mental distance " << r.mean_distance
+            << ", " << r.seconds << "s\n";
+}
+
+int main(int argc, char** argv) {
+    float tolerance = 0.1;
+    double energy_tolerance = 0.02;
+    std::string trace_file;
+    try {
+        if (argc > 4) {
+            throw std::invalid_argument("too many arguments");
+        }
+        if (argc > 1) {
+            tolerance = std::stof(argv[1]);
+        }
+        if (argc > 2) {
+            energy_tolerance = std::stod(argv[2]) / 100;
+        }
+        if (argc > 3) {
+            trace_file = argv[3];
+        }
+        if (energy_tolerance <= 0) {
+            throw std::invalid_argument("invalid value");
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "wrong arguments, usage: " << argv[0]
+                << " (tolerance=0.1) (energy tolerance %=2) (trace csv file) < graph\n"
+                << "Lays out the graph from the standard input, records the energy after\n"
+                << "every iteration and suggests shorter cooling schedules that reach\n"
+                << "the same final energy (within the energy tolerance).\n";
+        return 1;
+    }
+
+    try {
+        dyng::dynamic_graph input;
+        std::cin >> input;
+        if (input.states().empty()) {
+            throw std::runtime_error("empty input");
+        }
+
+        traced_layout defaults(tolerance, 1, 1);
+        schedules original{ defaults.static_layout().first_cooling(),
+                defaults.static_layout().second_cooling(),
+                defaults.tolerance_cooling() };
+        run_result base = run(input, tolerance, original);
+        if (!trace_file.empty()) {
+            std::ofstream out(trace_file);
+            base.trace.write_csv(out);
+            std::cout << "trace written to " << trace_file << "\n";
+        }
+
+        auto first = base.trace.rows(dyng::layout_phase::static_pass, 0);
+        auto second = base.trace.rows(dyng::layout_phase::static_pass, 1);
+        auto rounds = base.trace.rows(dyng::layout_phase::tolerance_round);
+        unsigned settled[] = { dyng::settled_iterations(first, energy_tolerance),
+                dyng::settled_iterations(second, energy_tolerance),
+                dyng::settled_iterations(rounds, energy_tolerance) };
+        std::cout << "energy settles within " << energy_tolerance * 100 << "% of the final value after\n"
+                << "  first pass: " << settled[0] << " of " << first.size() << " iterations\n"
+                << "  second pass: " << settled[1] << " of " << second.size() << " iterations\n"
+                << "  tolerance: " << settled[2] << " of " << rounds.size() << " rounds";
+        if (!rounds.empty()) {
+            std::cout << " (acceptance in the last round " << rounds.back().acceptance * 100 << "%)";
+        }
+        std::cout << "\n\n";
+
+        // the same temperature range in fewer iterations, lengthened until
+        // the final energies are as good as with the original schedules
+        double slack = 1;
+        for (unsigned attempt = 0; attempt < 6; ++attempt, slack *= 1.25) {
+            auto shorter = [&](const dyng::cooling& c, unsigned n){
+                return dyng::shortened_cooling(c,
+                        std::min<unsigned>(c.iterations, std::ceil(n * slack)));
+            };
+            schedules candidate{ shorter(original.first, settled[0]),
+                    shorter(original.second, settled[1]),
+                    shorter(original.tolerance, settled[2]) };
+            run_result check = run(input, tolerance, candidate);
+            bool good = check.static_energy <= base.static_energy * (1 + energy_tolerance)
+                    && check.tolerance_energy <= base.tolerance_energy * (1 + energy_tolerance);
+            std::cout << "attempt " << attempt + 1 << (good ? ": reaches the final energy\n" : ": too short\n");
+            if (!good) {
+                continue;
+            }
+            std::cout << "\noriginal schedules\n";
+            print_cooling("first", original.first);
+            print_cooling("second", original.second);
+            print_cooling("tolerance", original.tolerance);
+            std::cout << "suggested schedules\n";
+            print_cooling("first", candidate.first);
+            print_cooling("second", candidate.second);
+            print_cooling("tolerance", candidate.tolerance);
+            std::cout << "\n";
+            print_run("original", base);
+            print_run("suggested", check);
+            return 0;
+        }
+        std::cout << "\nno shorter schedule reaches the same energy, keep the original schedules\n";
+    } catch (const std::exception& ex) {
+        std::cerr << "ERROR: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib> // std::malloc, std::free
+#include <new>
+
+namespace demo {
+
+/// Counts heap allocations of the whole program.
+/**
+ * Counting only works in a program where exactly one translation unit
+ * contains DEMO_DEFINE_ALLOCATION_COUNTER, which replaces the global
+ * operators new and delete. Without it all values stay 0.
+ *
+ * For example:
+ *
+ *     auto before = demo::allocation_counter::allocations();
+ *     work();
+ *     auto count = demo::allocation_counter::allocations() - before;
+ */
+class allocation_counter {
+public:
+    /// Returns the number of allocations since the start of the program.
+    static std::uint64_t allocations() { return state().allocations; }
+
+    /// Returns the number of bytes currently allocated.
+    static std::int64_t current_bytes() { return state().current; }
+
+    /// Returns the highest number of allocated bytes since the last reset_peak.
+    static std::int64_t peak_bytes() { return state().peak; }
+
+    /// Sets the peak to the currently allocated bytes.
+    static void reset_peak() { state().peak = state().current.load(); }
+
+    /// Returns true if the operators are replaced, so the values are meaningful.
+    static bool enabled() { return state().enabled; }
+
+    // used by the replaced operators
+
+    static void* allocate(std::size_t size) {
+        auto& s = state();
+        s.enabled = true;
+        // the size is stored in front of the block, so that delete knows it
+        void* block = std::malloc(size + header);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        *static_cast<std::size_t*>(block) = size;
+        ++s.allocations;
+        std::int64_t now = s.current += size;
+        std::int64_t peak = s.peak;
+        while (now > peak && !s.peak.compare_exchange_weak(peak, now)) {}
+        return static_cast<char*>(block) + header;
+    }
+
+    // not inlined into the callers of delete, where GCC would warn about
+    // freeing a pointer returned by new
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#endif
+    static void deallocate(void* ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        void* block = static_cast<char*>(ptr) - header;
+        state().current -= *static_cast<std::size_t*>(block);
+        std::free(block);
+    }
+
+private:
+    // keeps the blocks aligned for any type
+    static constexpr std::size_t header = alignof(std::max_align_t);
+
+    struct counters {
+        std::atomic<std::uint64_t> allocations{ 0 };
+        std::atomic<std::int64_t> current{ 0 };
+        std::atomic<std::int64_t> peak{ 0 };
+        std::atomic<bool> enabled{ false };
+    };
+
+    static counters& state() {
+        static counters s;
+        return s;
+    }
+};
+
+} // namespace demo
+
+/// Replaces the global operators new and delete with counting ones.
+#define DEMO_DEFINE_ALLOCATION_COUNTER \
+    void* operator new(std::size_t size) { \
+        void* ptr = demo::allocation_counter::allocate(size); \
+        if (ptr == nullptr) { \
+            throw std::bad_alloc(); \
+        } \
+        return ptr; \
+    } \
+    void* operator new[](std::size_t size) { return operator new(size); } \
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept { \
+        return demo::allocation_counter::allocate(size); \
+    } \
+    void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { \
+        return demo::allocation_counter::allocate(size); \
+    } \
+    void operator delete(void* ptr) noexcept { demo::allocation_counter::deallocate(ptr); } \
+    void operator delete[](void* ptr) noexcept { demo::allocation_counter::deallocate(ptr); } \
+    void operator delete(void* ptr, std::size_t) noexcept { demo::allocation_counter::deallocate(ptr); } \
+    void operator delete[](void* ptr, std::size_t) noexcept { demo::allocation_counter::deallocate(ptr); } \
+    void operator delete(void* ptr, const std::nothrow_t&) noexcept { \
+        demo::allocation_counter::deallocate(ptr); \
+    } \
+    void operator delete[](void* ptr, const std::nothrow_t&) noexcept { \
+        demo::allocation_counter::deallocate(ptr); \
+    }
@@ -0,0 +1,194 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "perf_counters.h"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm> // std::sort
+#include <cmath> // std::floor, std::ceil
+#include <ostream>
+#include <iomanip> // std::setw, std::setprecision
+
+namespace demo {
+
+/// Measured samples of one benchmark.
+struct bench_result {
+    std::string name;
+    /// The size parameter of the input.
+    unsigned size = 0;
+    /// The number of operations done by one repetition.
+    double ops = 1;
+    /// Duration of every repetition in seconds, sorted.
+    std::vector<double> samples;
+    /// Hardware counters averaged over the repetitions, if they were measured.
+    counter_values counters;
+
+    /// Returns the p-th percentile of the samples (p in [0, 1]), linearly interpolated.
+    double percentile(double p) const {
+        if (samples.empty()) {
+            return 0;
+        }
+        double index = p * (samples.size() - 1);
+        unsigned low = std::floor(index);
+        unsigned high = std::ceil(index);
+        return samples[low] + (samples[high] - samples[low]) * (index - low);
+    }
+
+    double median() const { return percentile(0.5); }
+
+    /// Returns the number of operations per second, based on the median.
+    double ops_per_second() const {
+        double m = median();
+        return m > 0 ? ops / m : 0;
+    }
+};
+
+/// Prevents the compiler from removing a computation whose result is otherwise unused.
+template<typename T>
+void keep(const T& value) {
+    static const void* volatile sink;
+    sink = &value;
+    static_cast<void>(sink);
+}
+
+/// Runs benchmarks with warm-up and repetitions.
+/**
+ * Every repetition is timed separately, so the results show the spread
+ * and not only the mean; the median is robust to occasional interruptions.
+ * With set_counters, hardware counters are measured around every repetition too.
+ */
+class bench_harness {
+public:
+    bench_harness(unsigned repetitions = 15, unsigned warmup = 3)
+            : m_repetitions(std::max(repetitions, 1u))
+            , m_warmup(warmup) {}
+
+    /// Measures @p func, calling @p setup before every call without measuring it.
+    /**
+     * @param ops The number of operations done by one call of @p func,
+     * used to compute throughput.
+     */
+    template<typename Setup, typename Func>
+    bench_result run(std::string name, unsigned size, double ops, Setup setup, Func func) const {
+        using clock = std::chrono::steady_clock;
+        bench_result result;
+        result.name = std::move(name);
+        result.size = size;
+        result.ops = ops;
+        bool counting = m_counters != nullptr && m_counters->available();
+        counter_values sums;
+        for (unsigned i = 0; i < m_warmup + m_repetitions; ++i) {
+            setup();
+            if (counting) {
+                m_counters->start();
+            }
+            auto start = clock::now();
+            func();
+            std::chrono::duration<double> elapsed = clock::now() - start;
+            counter_values counted;
+            if (counting) {
+                counted = m_counters->stop();
+            }
+            if (i >= m_warmup) {
+                result.samples.push_back(elapsed.count());
+                for (unsigned c = 0; c < static_cast<unsigned>(hw_counter::count_); ++c) {
+                    if (counted.values[c] >= 0) {
+                        sums.values[c] = std::max(sums.values[c], 0.0) + counted.values[c];
+                    }
+                }
+            }
+        }
+        for (unsigned c = 0; c < static_cast<unsigned>(hw_counter::count_); ++c) {
+            if (sums.values[c] >= 0) {
+                result.counters.values[c] = sums.values[c] / m_repetitions;
+            }
+        }
+        std::sort(result.samples.begin(), result.samples.end());
+        return result;
+    }
+
+    /// Same as above, without setup.
+    template<typename Func>
+    bench_result run(std::string name, unsigned size, double ops, Func func) const {
+        return run(std::move(name), size, ops, [](){}, func);
+    }
+
+    unsigned repetitions() const { return m_repetitions; }
+    unsigned warmup() const { return m_warmup; }
+
+    /// Sets hardware counters measured around every repetition, nullptr to stop.
+    /**
+     * The counters must outlive all runs; they are only used
+     * if they are available.
+     */
+    void set_counters(perf_counters* counters) { m_counters = counters; }
+
+private:
+    unsigned m_repetitions;
+    unsigned m_warmup;
+    perf_counters* m_counters = nullptr;
+};
+
+/// Prints the header of the table printed by print_result.
+/**
+ * @param counters Adds columns of hardware counters (per repetition).
+ */
+inline void print_header(std::ostream& out, bool counters = false) {
+    out << std::left << std::setw(24) << "benchmark" << std::right
+            << std::setw(8) << "size"
+            << std::setw(14) << "median [us]"
+            << std::setw(14) << "p10 [us]"
+            << std::setw(14) << "p90 [us]"
+            << std::setw(16) << "ops/s";
+    if (counters) {
+        out << std::setw(8) << "IPC"
+                << std::setw(16) << "cache misses"
+                << std::setw(16) << "branch misses";
+    }
+    out << "\n";
+}
+
+/// Prints one row of a table of results.
+inline void print_result(std::ostream& out, const bench_result& r) {
+    out << std::left << std::setw(24) << r.name << std::right
+            << std::setw(8) << r.size
+            << std::fixed << std::setprecision(1)
+            << std::setw(14) << r.median() * 1e6
+            << std::setw(14) << r.percentile(0.1) * 1e6
+            << std::setw(14) << r.percentile(0.9) * 1e6
+            << std::setprecision(0)
+            << std::setw(16) << r.ops_per_second();
+    if (r.counters.any()) {
+        // counters that weren't measured are shown as '-'
+        auto print = [&](double value, int width, int precision){
+            out << std::setw(width);
+            if (value < 0) {
+                out << "-";
+            } else {
+                out << std::setprecision(precision) << value;
+            }
+        };
+        print(r.counters.ipc(), 8, 2);
+        print(r.counters[hw_counter::cache_misses], 16, 0);
+        print(r.counters[hw_counter::branch_misses], 16, 0);
+    }
+    out << std::endl;
+}
+
+} // namespace demo
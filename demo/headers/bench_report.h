@@ -0,0 +1,256 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <thread>
+#include <stdexcept>
+#include <cctype> // std::isspace
+#include <cstdlib> // std::strtod
+#include <cstdio> // std::snprintf
+
+#ifndef DYNG_CXX_FLAGS
+#define DYNG_CXX_FLAGS "unknown"
+#endif
+
+namespace demo {
+
+/// Describes the machine and the build, stored next to benchmark results.
+struct machine_info {
+    unsigned cores = 0;
+    std::string cpu;
+    std::string compiler;
+    std::string flags;
+
+    static machine_info current() {
+        machine_info info;
+        info.cores = std::thread::hardware_concurrency();
+        info.cpu = "unknown";
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                auto colon = line.find(':');
+                if (colon != std::string::npos && colon + 2 <= line.size()) {
+                    info.cpu = line.substr(colon + 2);
+                }
+                break;
+            }
+        }
+#if defined(__clang__)
+        info.compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+        info.compiler = "gcc " __VERSION__;
+#else
+        info.compiler = "unknown";
+#endif
+        info.flags = DYNG_CXX_FLAGS;
+        return info;
+    }
+};
+
+/// Returns @p str as a JSON string literal, including the quotes.
+inline std::string json_string(const std::string& str) {
+    std::string result = "\"";
+    for (char ch : str) {
+        switch (ch) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20) {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", ch);
+                    result += code;
+                } else {
+                    result += ch;
+                }
+        }
+    }
+    return result + "\"";
+}
+
+/// Writes machine information as a JSON object.
+inline void write_json(std::ostream& out, const machine_info& info) {
+    out << "{ \"cores\": " << info.cores
+            << ", \"cpu\": " << json_string(info.cpu)
+            << ", \"compiler\": " << json_string(info.compiler)
+            << ", \"flags\": " << json_string(info.flags) << " }";
+}
+
+
+/// A parsed JSON value, enough to read files written by the benchmark tools.
+/**
+ * Numbers are stored as doubles; escapes other than the ones written by
+ * json_string are kept as they are.
+ */
+struct json_value {
+    enum class type { null, boolean, number, string, array, object };
+
+    type kind = type::null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<json_value> array;
+    std::map<std::string, json_value> object;
+
+    /// Returns a member of an object.
+    /**
+     * @throw std::runtime_error If this is not an object or it has no such member.
+     */
+    const json_value& at(const std::string& key) const {
+        auto found = object.find(key);
+        if (kind != type::object || found == object.end()) {
+            throw std::runtime_error("missing JSON member '" + key + "'");
+        }
+        return found->second;
+    }
+
+    bool has(const std::string& key) const {
+        return kind == type::object && object.count(key) > 0;
+    }
+
+    /// Parses a whole stream.
+    /**
+     * @throw std::runtime_error If the input isn't valid JSON.
+     */
+    static json_value parse(std::istream& in) {
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::size_t pos = 0;
+        json_value result = parse(text, pos);
+        skip_space(text, pos);
+        if (pos != text.size()) {
+            throw std::runtime_error("unexpected characters after JSON value");
+        }
+        return result;
+    }
+
+private:
+    static void skip_space(const std::string& text, std::size_t& pos) {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+            ++pos;
+        }
+    }
+
+    static void expect(const std::string& text, std::size_t& pos, char ch) {
+        skip_space(text, pos);
+        if (pos >= text.size() || text[pos] != ch) {
+            throw std::runtime_error(std::string("expected '") + ch + "' in JSON");
+        }
+        ++pos;
+    }
+
+    static std::string parse_string(const std::string& text, std::size_t& pos) {
+        expect(text, pos, '"');
+        std::string result;
+        while (pos < text.size() && text[pos] != '"') {
+            if (text[pos] == '\\' && pos + 1 < text.size()) {
+                char ch = text[++pos];
+                switch (ch) {
+                    case 'n': result += '\n'; break;
+                    case 't': result += '\t'; break;
+                    case '"': case '\\': case '/': result += ch; break;
+                    default: result += '\\'; result += ch;
+                }
+            } else {
+                result += text[pos];
+            }
+            ++pos;
+        }
+        expect(text, pos, '"');
+        return result;
+    }
+
+    static json_value parse(const std::string& text, std::size_t& pos) {
+        skip_space(text, pos);
+        if (pos >= text.size()) {
+            throw std::runtime_error("unexpected end of JSON");
+        }
+        json_value result;
+        char ch = text[pos];
+        if (ch == '{') {
+            result.kind = type::object;
+            ++pos;
+            skip_space(text, pos);
+            if (pos < text.size() && text[pos] == '}') {
+                ++pos;
+                return result;
+            }
+            while (true) {
+                std::string key = parse_string(text, pos);
+                expect(text, pos, ':');
+                result.object[key] = parse(text, pos);
+                skip_space(text, pos);
+                if (pos < text.size() && text[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                expect(text, pos, '}');
+                return result;
+            }
+        }
+        if (ch == '[') {
+            result.kind = type::array;
+            ++pos;
+            skip_space(text, pos);
+            if (pos < text.size() && text[pos] == ']') {
+                ++pos;
+                return result;
+            }
+            while (true) {
+                result.array.push_back(parse(text, pos));
+                skip_space(text, pos);
+                if (pos < text.size() && text[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                expect(text, pos, ']');
+                return result;
+            }
+        }
+        if (ch == '"') {
+            result.kind = type::string;
+            result.string = parse_string(text, pos);
+            return result;
+        }
+        for (const char* word : { "true", "false", "null" }) {
+            std::string w = word;
+            if (text.compare(pos, w.size(), w) == 0) {
+                pos += w.size();
+                result.kind = w == "null" ? type::null : type::boolean;
+                result.boolean = w == "true";
+                return result;
+            }
+        }
+        const char* begin = text.c_str() + pos;
+        char* end = nullptr;
+        result.number = std::strtod(begin, &end);
+        if (end == begin) {
+            throw std::runtime_error("invalid JSON value");
+        }
+        result.kind = type::number;
+        pos += end - begin;
+        return result;
+    }
+};
+
+} // namespace demo
@@ -30,6 +30,7 @@ inline int draw_animation(int width, int height, const dyng::dynamic_graph& dgra
     demo::draw_context draw_context(width, height, "dyng demo");
 
     dyng::interpolator interpolator;
+    dyng::interpolator::frame_buffer frame;
 
     float state = 0;
     bool playing = true;
@@ -95,7 +96,7 @@ inline int draw_animation(int width, int height, const dyng::dynamic_graph& dgra
 
         draw_context.clear();
 
-        auto graph_state = interpolator(dgraph, state);
+        const auto& graph_state = interpolator(dgraph, state, frame);
         for (const auto& edge : graph_state.edges()) {
             draw_context.draw_edge(edge);
         }
@@ -20,6 +20,10 @@
 #include "generators/coupled_generator.h"
 #include "generators/grid_generator.h"
 #include "generators/triangle_grid_generator.h"
+#include "generators/barabasi_albert_generator.h"
+#include "generators/rmat_generator.h"
+#include "generators/sbm_generator.h"
+#include "generators/sliding_window_generator.h"
 
 #include <vector>
 #include <string>
@@ -67,6 +71,10 @@ public:
         m_generators.emplace("gen_tree", tree_generator::parse);
         m_generators.emplace("gen_grid", grid_generator::parse);
         m_generators.emplace("gen_triangle_grid", triangle_grid_generator::parse);
+        m_generators.emplace("gen_barabasi_albert", barabasi_albert_generator::parse);
+        m_generators.emplace("gen_rmat", rmat_generator::parse);
+        m_generators.emplace("gen_sbm", sbm_generator::parse);
+        m_generators.emplace("gen_sliding_window", sliding_window_generator::parse);
     }
 
     dyng::dynamic_graph operator()(const std::vector<std::string>& args) {
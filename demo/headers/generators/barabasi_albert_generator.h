@@ -0,0 +1,93 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "event_stream.h"
+
+#include <algorithm> // std::find
+
+namespace demo {
+
+/// Generates a growing scale-free graph by Barabási–Albert preferential attachment.
+/**
+ * Starts with @p edges_per_node nodes; every next node connects to
+ * @p edges_per_node distinct existing nodes chosen with probability proportional
+ * to their degree. Nodes arrive evenly over @p steps states.
+ */
+class barabasi_albert_generator : public stream_generator {
+public:
+    static std::unique_ptr<generator> parse(const std::vector<std::string>& args) {
+        using namespace std::string_literals;
+        if (args.size() != 6) {
+            throw std::runtime_error(
+                "wrong arguments, usage: "s
+                + args[0] + " "s + args[1]
+                + " [nodes] [edges per node] [steps] [seed]"s);
+        }
+        return std::make_unique<barabasi_albert_generator>(
+                std::stoi(args[2]),
+                std::stoi(args[3]),
+                std::stoi(args[4]),
+                std::stoi(args[5]));
+    }
+
+    barabasi_albert_generator(unsigned nodes
+            , unsigned edges_per_node
+            , unsigned steps
+            , unsigned seed = 0)
+            : stream_generator(steps, seed)
+            , m_node_count(nodes)
+            , m_edges_per_node(std::max(edges_per_node, 1u)) {}
+
+protected:
+    void fill(event_stream& stream) override {
+        unsigned initial = std::min(m_edges_per_node, m_node_count);
+        stream.reserve(m_node_count + static_cast<std::size_t>(m_node_count) * m_edges_per_node);
+        // every node appears here once for each of its edges, so picking
+        // a uniform entry picks a node proportionally to its degree
+        std::vector<unsigned> endpoints;
+        endpoints.reserve(2 * static_cast<std::size_t>(m_node_count) * m_edges_per_node);
+        std::vector<unsigned> targets;
+        for (unsigned i = 0; i < initial; ++i) {
+            stream.add_node(0);
+        }
+        for (unsigned i = initial; i < m_node_count; ++i) {
+            unsigned time = static_cast<std::uint64_t>(i) * step_count() / m_node_count;
+            unsigned node = stream.add_node(time);
+            targets.clear();
+            while (targets.size() < initial) {
+                // the first node connects to all initial nodes
+                unsigned target = endpoints.empty()
+                        ? static_cast<unsigned>(targets.size())
+                        : endpoints[uniform(endpoints.size())];
+                if (std::find(targets.begin(), targets.end(), target) == targets.end()) {
+                    targets.push_back(target);
+                }
+            }
+            for (unsigned target : targets) {
+                stream.add_edge(time, node, target);
+                endpoints.push_back(node);
+                endpoints.push_back(target);
+            }
+        }
+    }
+
+private:
+    unsigned m_node_count;
+    unsigned m_edges_per_node;
+};
+
+} // namespace demo
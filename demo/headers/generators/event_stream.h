@@ -0,0 +1,225 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "generator.h"
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm> // std::max, std::swap
+
+namespace demo {
+
+/// A single modification of a dynamic graph.
+struct graph_event {
+    enum class type : std::uint8_t { add_node, remove_node, add_edge, remove_edge };
+
+    type kind;
+    unsigned time;
+    /// The id of the node or the edge.
+    unsigned id;
+    /// The nodes connected by an added edge.
+    unsigned one;
+    unsigned two;
+};
+
+/// A flat sequence of modifications ordered by time.
+/**
+ * Unlike dyng::dynamic_graph, it stores plain records instead of closures,
+ * so millions of modifications take little memory and time. Ids are assigned
+ * from 0 in the same way as dyng::dynamic_graph assigns them.
+ *
+ * A node may only be removed after all of its edges were removed.
+ */
+class event_stream {
+public:
+    void reserve(std::size_t events) { m_events.reserve(events); }
+
+    void clear() {
+        m_events.clear();
+        m_node_count = 0;
+        m_edge_count = 0;
+    }
+
+    unsigned add_node(unsigned time) {
+        push(graph_event{ graph_event::type::add_node, time, m_node_count, 0, 0 });
+        return m_node_count++;
+    }
+
+    unsigned add_edge(unsigned time, unsigned one, unsigned two) {
+        push(graph_event{ graph_event::type::add_edge, time, m_edge_count, one, two });
+        return m_edge_count++;
+    }
+
+    void remove_node(unsigned time, unsigned id) {
+        push(graph_event{ graph_event::type::remove_node, time, id, 0, 0 });
+    }
+
+    void remove_edge(unsigned time, unsigned id) {
+        push(graph_event{ graph_event::type::remove_edge, time, id, 0, 0 });
+    }
+
+    const std::vector<graph_event>& events() const { return m_events; }
+
+    /// Returns the number of states, the time of the last event plus one.
+    unsigned steps() const { return m_events.empty() ? 0 : m_events.back().time + 1; }
+
+    unsigned node_count() const { return m_node_count; }
+    unsigned edge_count() const { return m_edge_count; }
+
+    /// Builds the states of the graph at all times.
+    /**
+     * @param steps The number of states; 0 means steps().
+     * @throw dyng::invalid_graph If an event refers to a missing element
+     * or a node with edges is removed.
+     */
+    std::vector<dyng::graph_state> states(unsigned steps = 0) const {
+        const unsigned none = std::numeric_limits<unsigned>::max();
+        steps = steps == 0 ? this->steps() : steps;
+        // live elements and their positions, removed by swapping with the last one
+        std::vector<unsigned> nodes;
+        std::vector<unsigned> node_position(m_node_count, none);
+        std::vector<unsigned> degree(m_node_count, 0);
+        std::vector<graph_event> edges;
+        std::vector<unsigned> edge_position(m_edge_count, none);
+
+        std::vector<dyng::graph_state> result;
+        result.reserve(steps);
+        auto event = m_events.begin();
+        for (unsigned t = 0; t < steps; ++t) {
+            for (; event != m_events.end() && event->time == t; ++event) {
+                switch (event->kind) {
+                    case graph_event::type::add_node:
+                        node_position[event->id] = nodes.size();
+                        nodes.push_back(event->id);
+                        break;
+                    case graph_event::type::remove_node:
+                        if (node_position[event->id] == none || degree[event->id] != 0) {
+                            throw dyng::invalid_graph("cannot remove node");
+                        }
+                        node_position[nodes.back()] = node_position[event->id];
+                        nodes[node_position[event->id]] = nodes.back();
+                        nodes.pop_back();
+                        node_position[event->id] = none;
+                        break;
+                    case graph_event::type::add_edge:
+                        if (node_position[event->one] == none || node_position[event->two] == none) {
+                            throw dyng::invalid_graph("node not available");
+                        }
+                        ++degree[event->one];
+                        ++degree[event->two];
+                        edge_position[event->id] = edges.size();
+                        edges.push_back(*event);
+                        break;
+                    case graph_event::type::remove_edge: {
+                        unsigned position = edge_position[event->id];
+                        if (position == none) {
+                            throw dyng::invalid_graph("edge not available");
+                        }
+                        --degree[edges[position].one];
+                        --degree[edges[position].two];
+                        edge_position[edges.back().id] = position;
+                        edges[position] = edges.back();
+                        edges.pop_back();
+                        edge_position[event->id] = none;
+                        break;
+                    }
+                }
+            }
+            dyng::graph_state state;
+            for (unsigned id : nodes) {
+                state.emplace_node(id);
+            }
+            for (const auto& e : edges) {
+                state.emplace_edge(e.id, e.one, e.two);
+            }
+            result.push_back(std::move(state));
+        }
+        return result;
+    }
+
+private:
+    std::vector<graph_event> m_events;
+    unsigned m_node_count = 0;
+    unsigned m_edge_count = 0;
+
+    void push(const graph_event& event) {
+        if (!m_events.empty() && event.time < m_events.back().time) {
+            throw std::invalid_argument("events must be ordered by time");
+        }
+        m_events.push_back(event);
+    }
+};
+
+
+/// Base of generators that produce an event_stream in bulk.
+/**
+ * generate() builds the states directly from the stream,
+ * without queueing a closure for every modification.
+ * generate_events() produces only the stream.
+ */
+class stream_generator : public generator {
+public:
+    stream_generator(unsigned steps, unsigned seed)
+            : m_steps(std::max(steps, 1u))
+            , m_seed(seed) {}
+
+    void generate() override {
+        generate_events();
+        m_result.build(m_stream.states(m_steps));
+    }
+
+    /// Generates the modifications only.
+    const event_stream& generate_events() {
+        // the same stream every time
+        m_rand.seed(m_seed);
+        m_stream.clear();
+        fill(m_stream);
+        return m_stream;
+    }
+
+    const event_stream& events() const { return m_stream; }
+
+    /// Returns the number of generated states.
+    unsigned step_count() const { return m_steps; }
+
+protected:
+    std::mt19937_64 m_rand;
+
+    /// Appends all modifications to @p stream.
+    virtual void fill(event_stream& stream) = 0;
+
+    // uniform in [0, count)
+    unsigned uniform(unsigned count) {
+        return std::uniform_int_distribution<unsigned>(0, count - 1)(m_rand);
+    }
+
+    static std::uint64_t pair_key(unsigned one, unsigned two) {
+        if (one > two) {
+            std::swap(one, two);
+        }
+        return (static_cast<std::uint64_t>(one) << 32) | two;
+    }
+
+private:
+    unsigned m_steps;
+    unsigned m_seed;
+    event_stream m_stream;
+};
+
+} // namespace demo
@@ -0,0 +1,114 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "event_stream.h"
+
+#include <unordered_set>
+
+namespace demo {
+
+/// Generates a growing graph with a skewed degree distribution by the R-MAT model.
+/**
+ * Every edge is placed by recursively choosing one of the quadrants
+ * of the adjacency matrix of 2^scale vertices with probabilities
+ * a, b, c and 1 - a - b - c. Edges arrive evenly over @p steps states and
+ * a vertex becomes a node when its first edge arrives. Loops and
+ * repeated edges are drawn again (up to a limit, then skipped).
+ */
+class rmat_generator : public stream_generator {
+public:
+    static std::unique_ptr<generator> parse(const std::vector<std::string>& args) {
+        using namespace std::string_literals;
+        if (args.size() != 6) {
+            throw std::runtime_error(
+                "wrong arguments, usage: "s
+                + args[0] + " "s + args[1]
+                + " [scale] [edges] [steps] [seed]"s);
+        }
+        return std::make_unique<rmat_generator>(
+                std::stoi(args[2]),
+                std::stoi(args[3]),
+                std::stoi(args[4]),
+                std::stoi(args[5]));
+    }
+
+    /**
+     * @throw std::invalid_argument If @p scale is over 30 or the probabilities
+     * are not a distribution.
+     */
+    rmat_generator(unsigned scale
+            , unsigned edges
+            , unsigned steps
+            , unsigned seed = 0
+            , double a = 0.57
+            , double b = 0.19
+            , double c = 0.19)
+            : stream_generator(steps, seed)
+            , m_scale(scale)
+            , m_edge_count(edges)
+            , m_a(a)
+            , m_b(b)
+            , m_c(c) {
+        if (scale > 30) {
+            throw std::invalid_argument("scale must be at most 30");
+        }
+        if (a < 0 || b < 0 || c < 0 || a + b + c > 1) {
+            throw std::invalid_argument("invalid quadrant probabilities");
+        }
+    }
+
+protected:
+    void fill(event_stream& stream) override {
+        const unsigned none = std::numeric_limits<unsigned>::max();
+        std::vector<unsigned> node_of(1u << m_scale, none);
+        std::unordered_set<std::uint64_t> existing;
+        existing.reserve(m_edge_count);
+        stream.reserve(3 * static_cast<std::size_t>(m_edge_count));
+        std::uniform_real_distribution<double> dis(0, 1);
+        for (unsigned e = 0; e < m_edge_count; ++e) {
+            unsigned time = static_cast<std::uint64_t>(e) * step_count() / m_edge_count;
+            for (unsigned attempt = 0; attempt < 16; ++attempt) {
+                unsigned one = 0;
+                unsigned two = 0;
+                for (unsigned bit = 0; bit < m_scale; ++bit) {
+                    double r = dis(m_rand);
+                    one = (one << 1) | (r >= m_a + m_b ? 1 : 0);
+                    two = (two << 1) | ((r >= m_a && r < m_a + m_b) || r >= m_a + m_b + m_c ? 1 : 0);
+                }
+                if (one == two || !existing.insert(pair_key(one, two)).second) {
+                    continue;
+                }
+                for (unsigned vertex : { one, two }) {
+                    if (node_of[vertex] == none) {
+                        node_of[vertex] = stream.add_node(time);
+                    }
+                }
+                stream.add_edge(time, node_of[one], node_of[two]);
+                break;
+            }
+        }
+    }
+
+private:
+    unsigned m_scale;
+    unsigned m_edge_count;
+    double m_a;
+    double m_b;
+    double m_c;
+};
+
+} // namespace demo
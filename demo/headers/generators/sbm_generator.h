@@ -0,0 +1,184 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "event_stream.h"
+
+#include <unordered_set>
+
+namespace demo {
+
+/// Generates a graph with communities (a sparse stochastic block model) whose nodes move between them.
+/**
+ * All nodes exist from the start and are split evenly into @p blocks communities.
+ * An average node has @p degree_in edges inside its community and
+ * @p degree_out edges to other communities. In every following state
+ * the fraction @p churn of nodes moves to another community: their edges
+ * are removed and the same number of edges is drawn in the new community.
+ */
+class sbm_generator : public stream_generator {
+public:
+    static std::unique_ptr<generator> parse(const std::vector<std::string>& args) {
+        using namespace std::string_literals;
+        if (args.size() != 9) {
+            throw std::runtime_error(
+                "wrong arguments, usage: "s
+                + args[0] + " "s + args[1]
+                + " [nodes] [blocks] [degree in] [degree out] [steps] [churn %] [seed]"s);
+        }
+        return std::make_unique<sbm_generator>(
+                std::stoi(args[2]),
+                std::stoi(args[3]),
+                std::stod(args[4]),
+                std::stod(args[5]),
+                std::stoi(args[6]),
+                std::stod(args[7]) / 100,
+                std::stoi(args[8]));
+    }
+
+    /**
+     * @throw std::invalid_argument If there are no blocks or @p churn is not in [0, 1].
+     */
+    sbm_generator(unsigned nodes
+            , unsigned blocks
+            , double degree_in
+            , double degree_out
+            , unsigned steps
+            , double churn
+            , unsigned seed = 0)
+            : stream_generator(steps, seed)
+            , m_node_count(nodes)
+            , m_blocks(blocks)
+            , m_degree_in(degree_in)
+            , m_degree_out(degree_out)
+            , m_churn(churn) {
+        if (blocks == 0 || churn < 0 || churn > 1) {
+            throw std::invalid_argument("invalid parameters");
+        }
+    }
+
+protected:
+    void fill(event_stream& stream) override {
+        m_block.assign(m_node_count, 0);
+        m_position.assign(m_node_count, 0);
+        m_members.assign(m_blocks, {});
+        m_incident.assign(m_node_count, {});
+        m_edges.clear();
+        m_existing.clear();
+        for (unsigned n = 0; n < m_node_count; ++n) {
+            stream.add_node(0);
+            join(n, n % m_blocks);
+        }
+        if (m_node_count < 2) {
+            return;
+        }
+        auto inside = static_cast<std::size_t>(m_node_count * m_degree_in / 2);
+        auto outside = static_cast<std::size_t>(m_node_count * m_degree_out / 2);
+        for (std::size_t i = 0; i < inside + outside; ++i) {
+            add_edge(stream, 0, uniform(m_node_count), i < inside);
+        }
+        double in_fraction = m_degree_in + m_degree_out > 0
+                ? m_degree_in / (m_degree_in + m_degree_out) : 1;
+        std::bernoulli_distribution pick_inside(in_fraction);
+        auto moves = static_cast<unsigned>(m_node_count * m_churn);
+        for (unsigned t = 1; t < step_count(); ++t) {
+            for (unsigned m = 0; m < moves && m_blocks > 1; ++m) {
+                unsigned node = uniform(m_node_count);
+                unsigned removed = 0;
+                for (unsigned e : m_incident[node]) {
+                    if (m_edges[e].alive) {
+                        m_edges[e].alive = false;
+                        m_existing.erase(pair_key(m_edges[e].one, m_edges[e].two));
+                        stream.remove_edge(t, e);
+                        ++removed;
+                    }
+                }
+                // edges of the other nodes are only marked, their lists are compacted here
+                m_incident[node].clear();
+                leave(node);
+                join(node, (m_block[node] + 1 + uniform(m_blocks - 1)) % m_blocks);
+                for (unsigned i = 0; i < removed; ++i) {
+                    add_edge(stream, t, node, pick_inside(m_rand));
+                }
+            }
+            for (auto& list : m_incident) {
+                if (list.size() > 16) {
+                    list.erase(std::remove_if(list.begin(), list.end(),
+                            [this](unsigned e){ return !m_edges[e].alive; }), list.end());
+                }
+            }
+        }
+    }
+
+private:
+    struct edge_entry {
+        unsigned one;
+        unsigned two;
+        bool alive;
+    };
+
+    unsigned m_node_count;
+    unsigned m_blocks;
+    double m_degree_in;
+    double m_degree_out;
+    double m_churn;
+
+    std::vector<unsigned> m_block;
+    // the position of every node in the list of members of its block
+    std::vector<unsigned> m_position;
+    std::vector<std::vector<unsigned>> m_members;
+    std::vector<std::vector<unsigned>> m_incident;
+    // indexed by edge ids
+    std::vector<edge_entry> m_edges;
+    std::unordered_set<std::uint64_t> m_existing;
+
+    void join(unsigned node, unsigned block) {
+        m_block[node] = block;
+        m_position[node] = m_members[block].size();
+        m_members[block].push_back(node);
+    }
+
+    void leave(unsigned node) {
+        auto& members = m_members[m_block[node]];
+        m_position[members.back()] = m_position[node];
+        members[m_position[node]] = members.back();
+        members.pop_back();
+    }
+
+    // adds an edge from @p node to a random node inside or outside of its block
+    void add_edge(event_stream& stream, unsigned time, unsigned node, bool inside) {
+        const auto& members = m_members[m_block[node]];
+        if (inside ? members.size() < 2 : members.size() == m_node_count) {
+            return;
+        }
+        for (unsigned attempt = 0; attempt < 16; ++attempt) {
+            unsigned other = inside
+                    ? members[uniform(members.size())]
+                    : uniform(m_node_count);
+            if (other == node || (!inside && m_block[other] == m_block[node])
+                    || !m_existing.insert(pair_key(node, other)).second) {
+                continue;
+            }
+            unsigned id = stream.add_edge(time, node, other);
+            m_edges.push_back(edge_entry{ node, other, true });
+            m_incident[node].push_back(id);
+            m_incident[other].push_back(id);
+            return;
+        }
+    }
+};
+
+} // namespace demo
@@ -0,0 +1,120 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "event_stream.h"
+
+#include <deque>
+#include <unordered_set>
+
+namespace demo {
+
+/// Generates a stream of edges where every edge lives for a fixed number of states.
+/**
+ * In every state @p edges_per_step edges between random vertices out of
+ * @p vertices arrive and the edges that arrived @p window states ago expire.
+ * A vertex is a node while it has edges; when it gets an edge again,
+ * it is added as a new node.
+ */
+class sliding_window_generator : public stream_generator {
+public:
+    static std::unique_ptr<generator> parse(const std::vector<std::string>& args) {
+        using namespace std::string_literals;
+        if (args.size() != 7) {
+            throw std::runtime_error(
+                "wrong arguments, usage: "s
+                + args[0] + " "s + args[1]
+                + " [vertices] [edges per step] [window] [steps] [seed]"s);
+        }
+        return std::make_unique<sliding_window_generator>(
+                std::stoi(args[2]),
+                std::stoi(args[3]),
+                std::stoi(args[4]),
+                std::stoi(args[5]),
+                std::stoi(args[6]));
+    }
+
+    sliding_window_generator(unsigned vertices
+            , unsigned edges_per_step
+            , unsigned window
+            , unsigned steps
+            , unsigned seed = 0)
+            : stream_generator(steps, seed)
+            , m_vertices(vertices)
+            , m_edges_per_step(edges_per_step)
+            , m_window(std::max(window, 1u)) {}
+
+protected:
+    void fill(event_stream& stream) override {
+        const unsigned none = std::numeric_limits<unsigned>::max();
+        std::vector<unsigned> node_of(m_vertices, none);
+        std::vector<unsigned> degree(m_vertices, 0);
+        struct live_edge {
+            unsigned id;
+            unsigned one;
+            unsigned two;
+            unsigned expires;
+        };
+        // ordered by arrival, so expired edges are at the front
+        std::deque<live_edge> live;
+        std::unordered_set<std::uint64_t> existing;
+        std::vector<unsigned> isolated;
+        stream.reserve(4 * static_cast<std::size_t>(m_edges_per_step) * step_count());
+        for (unsigned t = 0; t < step_count(); ++t) {
+            isolated.clear();
+            while (!live.empty() && live.front().expires == t) {
+                const auto& e = live.front();
+                stream.remove_edge(t, e.id);
+                existing.erase(pair_key(e.one, e.two));
+                for (unsigned vertex : { e.one, e.two }) {
+                    if (--degree[vertex] == 0) {
+                        isolated.push_back(vertex);
+                    }
+                }
+                live.pop_front();
+            }
+            for (unsigned i = 0; i < m_edges_per_step && m_vertices > 1; ++i) {
+                unsigned one = uniform(m_vertices);
+                unsigned two = uniform(m_vertices);
+                if (one == two || !existing.insert(pair_key(one, two)).second) {
+                    continue;
+                }
+                for (unsigned vertex : { one, two }) {
+                    if (node_of[vertex] == none) {
+                        node_of[vertex] = stream.add_node(t);
+                    }
+                    ++degree[vertex];
+                }
+                unsigned id = stream.add_edge(t, node_of[one], node_of[two]);
+                live.push_back(live_edge{ id, one, two, t + m_window });
+            }
+            // vertices that got no new edge leave
+            for (unsigned vertex : isolated) {
+                if (degree[vertex] == 0 && node_of[vertex] != none) {
+                    stream.remove_node(t, node_of[vertex]);
+                    node_of[vertex] = none;
+                }
+            }
+        }
+    }
+
+private:
+    unsigned m_vertices;
+    unsigned m_edges_per_step;
+    unsigned m_window;
+};
+
+} // namespace demo
@@ -0,0 +1,194 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring> // std::strerror, std::memset
+
+#if defined(__linux__)
+#define DEMO_HAS_PERF_EVENTS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace demo {
+
+/// A hardware event counted by perf_counters.
+enum class hw_counter : unsigned {
+    cycles,
+    instructions,
+    cache_misses,
+    branch_misses,
+    count_ // the number of counters
+};
+
+/// Returns a short name of a counter.
+inline const char* counter_name(hw_counter c) {
+    static const char* names[] = { "cycles", "instructions", "cache misses", "branch misses" };
+    static_assert(sizeof(names) / sizeof(*names) == static_cast<unsigned>(hw_counter::count_),
+            "a name for every counter");
+    return names[static_cast<unsigned>(c)];
+}
+
+/// Values of hardware counters; a negative value means that it wasn't counted.
+struct counter_values {
+    double values[static_cast<unsigned>(hw_counter::count_)] = { -1, -1, -1, -1 };
+
+    double& operator[](hw_counter c) { return values[static_cast<unsigned>(c)]; }
+    double operator[](hw_counter c) const { return values[static_cast<unsigned>(c)]; }
+
+    bool has(hw_counter c) const { return (*this)[c] >= 0; }
+
+    /// Returns true if at least one counter was counted.
+    bool any() const {
+        for (double v : values) {
+            if (v >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Returns instructions per cycle, or a negative value if unknown.
+    double ipc() const {
+        if (!has(hw_counter::cycles) || !has(hw_counter::instructions) || (*this)[hw_counter::cycles] == 0) {
+            return -1;
+        }
+        return (*this)[hw_counter::instructions] / (*this)[hw_counter::cycles];
+    }
+};
+
+/// Counts hardware events of the calling thread with Linux perf_event_open.
+/**
+ * Counters that cannot be opened (no permission, a virtual machine without
+ * a PMU, other platforms) are left out; if none can be opened, available()
+ * returns false, error() tells why, and all measured values are negative.
+ * Only user-space events are counted, which is allowed
+ * with the default perf_event_paranoid setting.
+ *
+ * Counters are measured only between start and stop, so the same object
+ * can measure many regions. If the kernel multiplexes the counters,
+ * the values are scaled by the fraction of time they were running.
+ */
+class perf_counters {
+public:
+    perf_counters() {
+        for (int& fd : m_fds) {
+            fd = -1;
+        }
+#ifdef DEMO_HAS_PERF_EVENTS
+        const std::uint64_t configs[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        for (unsigned i = 0; i < count; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            long fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fd < 0) {
+                if (m_error.empty()) {
+                    m_error = std::string("perf_event_open: ") + std::strerror(errno);
+                }
+                continue;
+            }
+            m_fds[i] = static_cast<int>(fd);
+        }
+#else
+        m_error = "hardware counters are only supported on Linux";
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    ~perf_counters() {
+#ifdef DEMO_HAS_PERF_EVENTS
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    /// Returns true if at least one counter can be measured.
+    bool available() const {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Returns the reason why some counter couldn't be opened, empty if all were.
+    const std::string& error() const { return m_error; }
+
+    /// Resets and starts all counters.
+    void start() {
+#ifdef DEMO_HAS_PERF_EVENTS
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    /// Stops all counters and returns the values counted since start.
+    counter_values stop() {
+        counter_values result;
+#ifdef DEMO_HAS_PERF_EVENTS
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for (unsigned i = 0; i < count; ++i) {
+            if (m_fds[i] < 0) {
+                continue;
+            }
+            // value, time enabled, time running
+            std::uint64_t data[3] = {};
+            if (read(m_fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))
+                    || data[2] == 0) {
+                continue;
+            }
+            result.values[i] = static_cast<double>(data[0])
+                    * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        }
+#endif
+        return result;
+    }
+
+private:
+    static constexpr unsigned count = static_cast<unsigned>(hw_counter::count_);
+
+    int m_fds[count];
+    std::string m_error;
+};
+
+} // namespace demo
@@ -0,0 +1,286 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "../../dyng/dyng.h"
+
+#include <istream>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception> // std::exception_ptr
+#include <stdexcept> // std::runtime_error
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <limits>
+#include <utility> // std::move
+
+namespace demo {
+
+/// A FIFO queue of limited capacity used to pass items between threads.
+/**
+ * push() blocks while the queue is full, pop() blocks while it is empty.
+ * After close() is called push() fails and pop() fails once the queue is drained.
+ */
+template<typename T>
+class bounded_queue {
+public:
+    explicit bounded_queue(unsigned capacity)
+            : m_capacity(capacity) {}
+
+    /// Returns false if the queue has been closed and the item was not added.
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this](){ return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) {
+            return false;
+        }
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /// Returns false if the queue has been closed and there are no items left.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this](){ return m_closed || !m_items.empty(); });
+        if (m_items.empty()) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+private:
+    unsigned m_capacity;
+    bool m_closed = false;
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+};
+
+
+/// Thrown by layout_pipeline, tells which graph of the input failed.
+class pipeline_error : public std::runtime_error {
+public:
+    pipeline_error(unsigned index, std::exception_ptr cause)
+            : std::runtime_error("graph " + std::to_string(index) + ": " + describe(cause))
+            , m_index(index)
+            , m_cause(std::move(cause)) {}
+
+    /// Returns the index of the failed graph in the input, counted from 0.
+    unsigned index() const { return m_index; }
+
+    /// Returns the exception thrown when processing the graph.
+    std::exception_ptr cause() const { return m_cause; }
+
+private:
+    unsigned m_index;
+    std::exception_ptr m_cause;
+
+    static std::string describe(const std::exception_ptr& cause) {
+        try {
+            std::rethrow_exception(cause);
+        } catch (const std::exception& ex) {
+            return ex.what();
+        } catch (...) {
+            return "unknown error";
+        }
+    }
+};
+
+
+/// Reads dynamic graphs from a stream, lays them out and writes them in the input order.
+/**
+ * The work is split into three stages connected by bounded queues:
+ * a reader thread parsing the input, @p workers threads computing layouts
+ * (each with its own layout object) and a writer thread. This way reading
+ * and writing overlap with the computation and multiple graphs can be
+ * laid out at the same time.
+ *
+ * The number of graphs that are in the pipeline at once is limited, so memory
+ * usage does not depend on the length of the input.
+ *
+ * @tparam MakeLayout Function object returning a new layout object, called once
+ * per worker. Expected signature: 'Layout()'.
+ * @tparam Write Function object writing a finished graph, called from the writer
+ * thread only. Expected signature: 'void(std::ostream&, const dyng::dynamic_graph&)'.
+ * @throw pipeline_error With the first exception thrown by any of the stages
+ * and the index of the graph it was processing, after all graphs preceding
+ * the failed one have been written. If a layout object cannot be created,
+ * the failed graph is the one that worker would lay out first.
+ */
+template<typename MakeLayout, typename Write>
+void layout_pipeline(
+        std::istream& in
+        , std::ostream& out
+        , unsigned workers
+        , MakeLayout make_layout
+        , Write write) {
+    if (workers == 0) {
+        workers = 1;
+    }
+    struct item {
+        unsigned index = 0;
+        dyng::dynamic_graph dgraph;
+    };
+    // graphs that have been read but not written yet
+    const unsigned capacity = workers * 2;
+    bounded_queue<item> input(capacity);
+    bounded_queue<item> output(capacity);
+
+    std::mutex mutex;
+    std::condition_variable slot_free;
+    unsigned pending = 0;
+    std::exception_ptr error;
+    unsigned failed_index = std::numeric_limits<unsigned>::max();
+    auto fail = [&](unsigned index){
+        std::lock_guard<std::mutex> lock(mutex);
+        if (index < failed_index) {
+            failed_index = index;
+            error = std::current_exception();
+        }
+        slot_free.notify_all();
+    };
+    // graphs following a failed one are not needed anymore
+    auto skip = [&](unsigned index){
+        std::lock_guard<std::mutex> lock(mutex);
+        return index >= failed_index;
+    };
+
+    std::thread reader([&](){
+        unsigned index = 0;
+        try {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    slot_free.wait(lock, [&](){ return error || pending < capacity; });
+                    if (error) {
+                        break;
+                    }
+                    ++pending;
+                }
+                item it;
+                it.index = index;
+                if (!(in >> it.dgraph) || !input.push(std::move(it))) {
+                    break;
+                }
+                ++index;
+            }
+        } catch (...) {
+            fail(index);
+        }
+        input.close();
+    });
+
+    std::vector<std::thread> layouters;
+    layouters.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i) {
+        layouters.emplace_back([&](){
+            item it;
+            bool created = false;
+            try {
+                auto layout = make_layout();
+                created = true;
+                while (input.pop(it)) {
+                    if (skip(it.index)) {
+                        continue;
+                    }
+                    layout(it.dgraph);
+                    output.push(std::move(it));
+                }
+            } catch (...) {
+                // without a layout object the next graph can't be laid out,
+                // if there is none left, nothing was lost
+                if (created || input.pop(it)) {
+                    fail(it.index);
+                }
+                // keep draining so that the reader is never blocked
+                while (input.pop(it)) {}
+            }
+        });
+    }
+
+    std::thread writer([&](){
+        // results can arrive out of order, this restores the input order
+        std::map<unsigned, dyng::dynamic_graph> finished;
+        unsigned next = 0;
+        item it;
+        while (output.pop(it)) {
+            finished.emplace(it.index, std::move(it.dgraph));
+            for (auto found = finished.find(next); found != finished.end();
+                    found = finished.find(next)) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (next >= failed_index) {
+                        break;
+                    }
+                }
+                try {
+                    write(out, found->second);
+                } catch (...) {
+                    fail(next);
+                    break;
+                }
+                finished.erase(found);
+                ++next;
+                std::lock_guard<std::mutex> lock(mutex);
+                --pending;
+                slot_free.notify_all();
+            }
+        }
+    });
+
+    reader.join();
+    for (auto& th : layouters) {
+        th.join();
+    }
+    output.close();
+    writer.join();
+    if (error) {
+        throw pipeline_error(failed_index, error);
+    }
+}
+
+/// Same as above, graphs are written using operator<<.
+template<typename MakeLayout>
+void layout_pipeline(
+        std::istream& in
+        , std::ostream& out
+        , unsigned workers
+        , MakeLayout make_layout) {
+    layout_pipeline(in, out, workers, make_layout,
+            [](std::ostream& str, const dyng::dynamic_graph& dgraph){ str << dgraph; });
+}
+
+} // namespace demo
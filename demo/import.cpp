@@ -0,0 +1,68 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "../dyng/dyng.h"
+
+#include <iostream>
+#include <string> // std::stod, std::stoi
+
+namespace {
+
+void usage(const char* name) {
+    std::cerr << "wrong arguments, usage:\n"
+            << "\t" << name << " graphml (time step=1)\n"
+            << "\t" << name << " edges (time step=1) (delimiter=whitespace) (edge lifetime=0)\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 5) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string format = argv[1];
+    dyng::dynamic_graph dgraph;
+    try {
+        if (format == "graphml" && argc <= 3) {
+            dyng::graphml_reader reader;
+            if (argc > 2) {
+                reader.set_time_step(std::stod(argv[2]));
+            }
+            reader(std::cin, dgraph);
+        } else if (format == "edges") {
+            dyng::edge_list_reader reader;
+            if (argc > 2) {
+                reader.set_time_step(std::stod(argv[2]));
+            }
+            if (argc > 3) {
+                std::string delimiter = argv[3];
+                reader.set_delimiter(delimiter == "tab" ? '\t' : delimiter.at(0));
+            }
+            if (argc > 4) {
+                reader.set_edge_lifetime(std::stoi(argv[4]));
+            }
+            reader(std::cin, dgraph);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "ERROR: " << ex.what() << std::endl;
+        return 1;
+    }
+    std::cout << dgraph;
+    return 0;
+}
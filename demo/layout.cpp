@@ -14,28 +14,62 @@
    limitations under the License.
 */
 #include "../dyng/dyng.h"
+#include "headers/pipeline.h"
 
 #include <iostream>
-#include <string> // std::stof
+#include <string> // std::stof, std::stoi
 
 int main(int argc, char** argv) {
-    if (argc != 4) {
-        std::cerr << "wrong arguments, usage: " << argv[0] << " [tolerance] [width] [height]\n";
+    if (argc < 4 || argc > 7) {
+        std::cerr << "wrong arguments, usage: " << argv[0]
+                << " [tolerance] [width] [height] (workers=1) (bits=0) (cache directory)\n";
         return 1;
     }
     dyng::default_layout layout;
+    unsigned workers = 1;
+    dyng::quantization quantization;
     try {
         layout.set_tolerance(std::stof(argv[1]));
         layout.set_canvas(std::stof(argv[2]), std::stof(argv[3]));
+        if (argc >= 5) {
+            int value = std::stoi(argv[4]);
+            if (value < 1) {
+                throw std::invalid_argument("workers < 1");
+            }
+            workers = value;
+        }
+        if (argc >= 6) {
+            int bits = std::stoi(argv[5]);
+            if (bits < 0 || bits > 24) {
+                throw std::invalid_argument("bits out of range");
+            }
+            if (bits != 0) {
+                quantization = dyng::quantization(bits,
+                        layout.canvas_width(), layout.canvas_height(), layout.center());
+            }
+        }
     } catch (std::exception& ex) {
-        std::cerr << "invalid numbers, usage: " << argv[0] << " [tolerance] [width] [height]\n";
+        std::cerr << "invalid numbers, usage: " << argv[0]
+                << " [tolerance] [width] [height] (workers=1) (bits=0) (cache directory)\n"
+                << "workers has to be at least 1, bits between 0 (no quantization) and 24\n";
         return 1;
     }
-    dyng::dynamic_graph dgraph;
+    auto write = [&quantization](std::ostream& out, const dyng::dynamic_graph& dgraph){
+        if (quantization.enabled()) {
+            dyng::write_quantized(out, dgraph, quantization);
+        } else {
+            out << dgraph;
+        }
+    };
     try {
-        while (std::cin >> dgraph) {
-            layout(dgraph);
-            std::cout << dgraph;
+        // each worker lays out a different graph from the input
+        if (argc == 7) {
+            dyng::layout_cache cache(argv[6]);
+            demo::layout_pipeline(std::cin, std::cout, workers, [&](){
+                return dyng::cached_layout<dyng::default_layout>(layout, cache);
+            }, write);
+        } else {
+            demo::layout_pipeline(std::cin, std::cout, workers, [&layout](){ return layout; }, write);
         }
     } catch (const std::exception& ex) {
         std::cerr << "ERROR: " << ex.what() << std::endl;
@@ -0,0 +1,221 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "../dyng/dyng.h"
+#include "headers/examples.h"
+#include "headers/bench_harness.h"
+
+#include <iostream>
+#include <sstream> // std::stringstream
+#include <string> // std::stoi
+#include <cmath> // std::sqrt
+#include <unordered_map>
+
+// makes the internal stages of the algorithm accessible
+class exposed_layout : public dyng::default_layout {
+public:
+    using dyng::default_layout::node_live_times;
+    using dyng::default_layout::edge_live_times;
+    using dyng::default_layout::calculate_supergraph;
+    using dyng::default_layout::calculate_gap;
+    using dyng::default_layout::calculate_rgap;
+    using dyng::default_layout::distance;
+};
+
+// returns a dynamic graph with modifications that build the same states
+dyng::dynamic_graph replay(const dyng::dynamic_graph& dgraph) {
+    dyng::dynamic_graph result;
+    std::unordered_map<dyng::node_id, dyng::node_id> nodes;
+    std::unordered_map<dyng::edge_id, dyng::edge_id> edges;
+    const auto& states = dgraph.states();
+    for (unsigned t = 0; t < states.size(); ++t) {
+        if (t > 0) {
+            for (const auto& e : states[t - 1].edges()) {
+                if (!states[t].edge_exists(e.id())
+                        && states[t].node_exists(e.one_id())
+                        && states[t].node_exists(e.two_id())) {
+                    result.remove_edge(t, edges.at(e.id()));
+                }
+            }
+            for (const auto& n : states[t - 1].nodes()) {
+                if (!states[t].node_exists(n.id())) {
+                    result.remove_node(t, nodes.at(n.id()));
+                }
+            }
+        }
+        for (const auto& n : states[t].nodes()) {
+            if (nodes.count(n.id()) == 0) {
+                nodes.emplace(n.id(), result.add_node(t));
+            }
+        }
+        for (const auto& e : states[t].edges()) {
+            if (edges.count(e.id()) == 0) {
+                edges.emplace(e.id(), result.add_edge(t, nodes.at(e.one_id()), nodes.at(e.two_id())));
+            }
+        }
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    unsigned repetitions = 15;
+    unsigned warmup = 3;
+    std::string filter;
+    std::vector<unsigned> sizes{ 8, 16, 32 };
+
+    try {
+        if (argc > 4) {
+            throw std::invalid_argument("too many arguments");
+        }
+        if (argc > 1) {
+            int value = std::stoi(argv[1]);
+            if (value < 1) {
+                throw std::invalid_argument("repetitions < 1");
+            }
+            repetitions = value;
+        }
+        if (argc > 2) {
+            int value = std::stoi(argv[2]);
+            if (value < 0) {
+                throw std::invalid_argument("warm-up < 0");
+            }
+            warmup = value;
+        }
+        if (argc > 3) {
+            filter = argv[3];
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "wrong arguments\n"
+                << "usage: " << argv[0] << " (repetitions=15) (warm-up=3) (name filter)\n";
+        return 1;
+    }
+
+    demo::bench_harness harness(repetitions, warmup);
+    demo::perf_counters counters;
+    harness.set_counters(&counters);
+    auto report = [&](const std::string& name, auto&& measure){
+        if (name.find(filter) != std::string::npos) {
+            demo::print_result(std::cout, measure(name));
+        }
+    };
+
+    std::cout << "repetitions: " << harness.repetitions()
+            << ", warm-up: " << harness.warmup() << "\n";
+    if (!counters.available()) {
+        std::cout << "hardware counters unavailable (" << counters.error() << ")\n";
+    } else if (!counters.error().empty()) {
+        std::cout << "some hardware counters unavailable (" << counters.error() << ")\n";
+    }
+    demo::print_header(std::cout, counters.available());
+
+    for (unsigned size : sizes) {
+        dyng::dynamic_graph dgraph = demo::generate<demo::grid_generator>(size);
+        dyng::dynamic_graph laid_out = dgraph;
+        exposed_layout layout;
+        layout(laid_out);
+        const dyng::graph_state& last = laid_out.states().back();
+        unsigned nodes = last.nodes().size();
+
+        report("fr iteration", [&](const std::string& name){
+            dyng::graph_state state = last;
+            dyng::fruchterman_reingold<dyng::initial_placement> fr;
+            dyng::fruchterman_reingold<dyng::initial_placement>::workspace ws;
+            return harness.run(name, size, 1, [&](){
+                fr.iteration(state, 1, 1, 0.01, ws);
+            });
+        });
+
+        report("grid build", [&](const std::string& name){
+            float k = 0.6f * std::sqrt(1.0f / nodes);
+            return harness.run(name, size, nodes, [&](){
+                dyng::detail::optimization_grid grid(1, 1, k);
+                for (unsigned i = 0; i < nodes; ++i) {
+                    grid.add(last.nodes()[i].pos(), i);
+                }
+                grid.sort();
+                demo::keep(grid);
+            });
+        });
+
+        const auto& states = dgraph.states();
+        auto nodes_live = layout.node_live_times(states);
+        auto edges_live = layout.edge_live_times(states);
+        auto supergraph = layout.calculate_supergraph(states);
+        report("calculate_gap", [&](const std::string& name){
+            return harness.run(name, size, 1, [&](){
+                auto gap = layout.calculate_gap(supergraph, nodes_live, edges_live);
+                demo::keep(gap);
+            });
+        });
+
+        auto gap = layout.calculate_gap(supergraph, nodes_live, edges_live);
+        report("calculate_rgap", [&](const std::string& name){
+            dyng::detail::mapped_graph input;
+            return harness.run(name, size, 1, [&](){ input = gap; }, [&](){
+                auto rgap = layout.calculate_rgap(std::move(input));
+                demo::keep(rgap);
+            });
+        });
+
+        report("distance", [&](const std::string& name){
+            const auto& previous = laid_out.states()[laid_out.states().size() - 2];
+            return harness.run(name, size, 1, [&](){
+                float d = layout.distance(last, previous);
+                demo::keep(d);
+            });
+        });
+
+        report("dynamic_graph::build", [&](const std::string& name){
+            // building consumes the modifications, so they are queued again every time
+            dyng::dynamic_graph copy;
+            return harness.run(name, size, states.size(), [&](){ copy = replay(dgraph); }, [&](){
+                copy.build();
+            });
+        });
+
+        report("interpolator", [&](const std::string& name){
+            dyng::interpolator interpolate;
+            const unsigned frames = 100;
+            float step = interpolate.length(laid_out) / frames;
+            return harness.run(name, size, frames, [&](){
+                for (unsigned f = 0; f < frames; ++f) {
+                    auto frame = interpolate(laid_out, f * step);
+                    demo::keep(frame);
+                }
+            });
+        });
+
+        std::stringstream text;
+        text << laid_out;
+        std::string written = text.str();
+        report("write [bytes]", [&](const std::string& name){
+            return harness.run(name, size, written.size(), [&](){
+                std::stringstream out;
+                out << laid_out;
+                demo::keep(out);
+            });
+        });
+
+        report("parse [bytes]", [&](const std::string& name){
+            return harness.run(name, size, written.size(), [&](){
+                std::stringstream in(written);
+                dyng::dynamic_graph parsed;
+                in >> parsed;
+                demo::keep(parsed);
+            });
+        });
+    }
+    return 0;
+}
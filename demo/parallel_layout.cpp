@@ -14,29 +14,73 @@
    limitations under the License.
 */
 #include "../dyng/dyng.h"
+#include "headers/pipeline.h"
 
 #include <iostream>
 #include <string> // std::stof, std::stoi
+#include <limits>
 
 int main(int argc, char** argv) {
-    if (argc != 5) {
-        std::cerr << "wrong arguments, usage: " << argv[0] << " [threads] [tolerance] [width] [height]\n";
+    if (argc < 5 || argc > 8) {
+        std::cerr << "wrong arguments, usage: " << argv[0]
+                << " [threads] [tolerance] [width] [height] (workers=1) (bits=0) (cache directory)\n";
         return 1;
     }
-    dyng::default_layout_parallel layout;
+    unsigned threads;
+    float tolerance;
+    float width;
+    float height;
+    unsigned workers = 1;
+    unsigned bits = 0;
+    // a negative value would wrap around when stored as unsigned
+    auto parse = [](const char* arg, int min, int max) -> unsigned {
+        int value = std::stoi(arg);
+        if (value < min || value > max) {
+            throw std::invalid_argument("value out of range");
+        }
+        return value;
+    };
     try {
-        layout.set_threads(std::stoi(argv[1]));
-        layout.set_tolerance(std::stof(argv[2]));
-        layout.set_canvas(std::stof(argv[3]), std::stof(argv[4]));
+        threads = parse(argv[1], 1, std::numeric_limits<int>::max());
+        tolerance = std::stof(argv[2]);
+        width = std::stof(argv[3]);
+        height = std::stof(argv[4]);
+        if (argc >= 6) {
+            workers = parse(argv[5], 1, std::numeric_limits<int>::max());
+        }
+        if (argc >= 7) {
+            bits = parse(argv[6], 0, 24);
+        }
     } catch (std::exception& ex) {
-        std::cerr << "invalid numbers, usage: " << argv[0] << " [threads] [tolerance] [width] [height]\n";
+        std::cerr << "invalid numbers, usage: " << argv[0]
+                << " [threads] [tolerance] [width] [height] (workers=1) (bits=0) (cache directory)\n"
+                << "threads and workers have to be at least 1, bits between 0 (no quantization) and 24\n";
         return 1;
     }
-    dyng::dynamic_graph dgraph;
+    dyng::quantization quantization;
+    auto write = [&quantization](std::ostream& out, const dyng::dynamic_graph& dgraph){
+        if (quantization.enabled()) {
+            dyng::write_quantized(out, dgraph, quantization);
+        } else {
+            out << dgraph;
+        }
+    };
     try {
-        while (std::cin >> dgraph) {
-            layout(dgraph);
-            std::cout << dgraph;
+        if (bits != 0) {
+            quantization = dyng::quantization(bits, width, height);
+        }
+        // every worker owns a layout object, but they all share the same threads
+        dyng::executor exec(threads);
+        auto make_layout = [&](){
+            return dyng::default_layout_parallel(exec, tolerance, width, height);
+        };
+        if (argc == 8) {
+            dyng::layout_cache cache(argv[7]);
+            demo::layout_pipeline(std::cin, std::cout, workers, [&](){
+                return dyng::cached_layout<dyng::default_layout_parallel>(make_layout(), cache);
+            }, write);
+        } else {
+            demo::layout_pipeline(std::cin, std::cout, workers, make_layout, write);
         }
     } catch (const std::exception& ex) {
         std::cerr << "ERROR: " << ex.what() << std::endl;
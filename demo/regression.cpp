@@ -0,0 +1,335 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "../dyng/dyng.h"
+#include "headers/examples.h"
+#include "headers/bench_harness.h"
+#include "headers/bench_report.h"
+#include "headers/allocation_counter.h"
+
+#include <iostream>
+#include <iomanip> // std::setw, std::setprecision
+#include <fstream>
+#include <string> // std::stoi, std::stod
+#include <vector>
+#include <functional>
+#include <algorithm> // std::sort
+#include <cmath> // std::sqrt, std::erfc
+
+DEMO_DEFINE_ALLOCATION_COUNTER
+
+// exit code when a regression is found, wrong arguments and errors return 1
+const int regression_found = 2;
+
+// one entry of the benchmark matrix
+struct bench_case {
+    std::string name;
+    std::function<dyng::dynamic_graph()> input;
+    std::function<void(dyng::dynamic_graph&)> layout;
+};
+
+// measurements of one case
+struct case_result {
+    std::string name;
+    std::vector<double> samples;
+    double peak_bytes = 0;
+    double allocations = 0;
+    double crossings = 0;
+    double stress = 0;
+    double mean_distance = 0;
+};
+
+// the fixed matrix, kept small so that a run with 7 repetitions takes about a minute
+std::vector<bench_case> matrix() {
+    const float tolerance = 0.1;
+    auto serial = [=](dyng::dynamic_graph& dgraph){ dyng::default_layout(tolerance, 1, 1)(dgraph); };
+    auto parallel = [=](dyng::dynamic_graph& dgraph){ dyng::default_layout_parallel(2, tolerance)(dgraph); };
+    return {
+        { "serial grid 12", [](){ return demo::generate<demo::grid_generator>(12); }, serial },
+        { "serial triangle 12", [](){ return demo::generate<demo::triangle_grid_generator>(12); }, serial },
+        { "parallel grid 16 x2", [](){ return demo::generate<demo::grid_generator>(16); }, parallel },
+        { "serial barabasi-albert 300",
+                [](){ return demo::generate<demo::barabasi_albert_generator>(300, 2, 10, 1); }, serial },
+        { "serial sbm 300",
+                [](){ return demo::generate<demo::sbm_generator>(300, 4, 4.0, 1.0, 8, 0.05, 1); }, serial },
+    };
+}
+
+std::vector<case_result> run_matrix(unsigned repetitions) {
+    demo::bench_harness harness(repetitions, 1);
+    std::vector<case_result> results;
+    for (const auto& c : matrix()) {
+        std::cerr << "running " << c.name << std::endl;
+        dyng::dynamic_graph input = c.input();
+        dyng::dynamic_graph copy;
+        case_result result;
+        result.name = c.name;
+        result.samples = harness.run(c.name, 0, 1, [&](){ copy = input; }, [&](){
+            c.layout(copy);
+        }).samples;
+
+        // memory is measured in a separate run, so counting doesn't affect the times
+        copy = input;
+        auto base = demo::allocation_counter::current_bytes();
+        auto allocations = demo::allocation_counter::allocations();
+        demo::allocation_counter::reset_peak();
+        c.layout(copy);
+        result.peak_bytes = demo::allocation_counter::peak_bytes() - base;
+        result.allocations = demo::allocation_counter::allocations() - allocations;
+
+        auto quality = dyng::measure_quality(copy, 0.001f);
+        result.crossings = quality.crossings;
+        result.stress = quality.stress;
+        result.mean_distance = quality.mean_mental_distance;
+        results.push_back(result);
+    }
+    return results;
+}
+
+void write_baseline(std::ostream& out, const std::vector<case_result>& results) {
+    out << std::setprecision(9);
+    out << "{\n  \"machine\": ";
+    demo::write_json(out, demo::machine_info::current());
+    out << ",\n  \"cases\": [";
+    for (unsigned i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+                << "    { \"name\": " << demo::json_string(r.name)
+                << ", \"samples\": [";
+        for (unsigned s = 0; s < r.samples.size(); ++s) {
+            out << (s == 0 ? "" : ", ") << r.samples[s];
+        }
+        out << "], \"peak_bytes\": " << r.peak_bytes
+                << ", \"allocations\": " << r.allocations
+                << ", \"crossings\": " << r.crossings
+                << ", \"stress\": " << r.stress
+                << ", \"mean_distance\": " << r.mean_distance << " }";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+std::vector<case_result> read_baseline(const demo::json_value& json) {
+    std::vector<case_result> results;
+    for (const auto& c : json.at("cases").array) {
+        case_result r;
+        r.name = c.at("name").string;
+        for (const auto& s : c.at("samples").array) {
+            r.samples.push_back(s.number);
+        }
+        r.peak_bytes = c.at("peak_bytes").number;
+        r.allocations = c.at("allocations").number;
+        r.crossings = c.at("crossings").number;
+        r.stress = c.at("stress").number;
+        r.mean_distance = c.at("mean_distance").number;
+        results.push_back(r);
+    }
+    return results;
+}
+
+// one-sided Mann-Whitney U test, returns the p-value of 'current' being larger than 'baseline'
+double mann_whitney(const std::vector<double>& current, const std::vector<double>& baseline) {
+    struct sample {
+        double value;
+        bool is_current;
+    };
+    std::vector<sample> all;
+    for (double v : current) {
+        all.push_back({ v, true });
+    }
+    for (double v : baseline) {
+        all.push_back({ v, false });
+    }
+    std::sort(all.begin(), all.end(), [](const sample& a, const sample& b){ return a.value < b.value; });
+    double n1 = current.size();
+    double n2 = baseline.size();
+    double n = n1 + n2;
+    if (n1 == 0 || n2 == 0) {
+        return 1;
+    }
+    // ranks, ties get the average rank
+    double rank_sum = 0;
+    double ties = 0;
+    for (unsigned i = 0; i < all.size();) {
+        unsigned j = i;
+        while (j < all.size() && all[j].value == all[i].value) {
+            ++j;
+        }
+        double rank = (i + 1 + j) / 2.0;
+        for (unsigned k = i; k < j; ++k) {
+            if (all[k].is_current) {
+                rank_sum += rank;
+            }
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    double u = rank_sum - n1 * (n1 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    if (variance <= 0) {
+        return 1;
+    }
+    // normal approximation with continuity correction
+    double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+double median(std::vector<double> samples) {
+    demo::bench_result r;
+    std::sort(samples.begin(), samples.end());
+    r.samples = std::move(samples);
+    return r.median();
+}
+
+// relative change, with a floor so that values close to 0 don't explode
+double change(double current, double baseline, double floor = 0) {
+    return (current - baseline) / std::max(std::abs(baseline), floor);
+}
+
+int compare(const std::vector<case_result>& baseline
+        , const std::vector<case_result>& current
+        , double threshold
+        , double alpha) {
+    bool regressed = false;
+    std::cout << std::fixed;
+    std::cout << std::left << std::setw(28) << "case" << std::right
+            << std::setw(12) << "base [s]"
+            << std::setw(12) << "new [s]"
+            << std::setw(10) << "time"
+            << std::setw(10) << "p"
+            << std::setw(10) << "memory"
+            << std::setw(10) << "allocs"
+            << std::setw(10) << "quality" << "  verdict\n";
+    for (const auto& now : current) {
+        auto found = std::find_if(baseline.begin(), baseline.end(),
+                [&](const case_result& b){ return b.name == now.name; });
+        if (found == baseline.end()) {
+            std::cout << std::left << std::setw(28) << now.name << "  not in baseline\n";
+            continue;
+        }
+        const auto& base = *found;
+        double time_change = change(median(now.samples), median(base.samples));
+        double p = mann_whitney(now.samples, base.samples);
+        double memory_change = change(now.peak_bytes, base.peak_bytes, 1);
+        double allocation_change = change(now.allocations, base.allocations, 1);
+        // the largest relative worsening of the quality metrics
+        double quality_change = std::max({ change(now.crossings, base.crossings, 1),
+                change(now.stress, base.stress, 1e-3),
+                change(now.mean_distance, base.mean_distance, 1e-3) });
+
+        std::string verdict;
+        if (time_change > threshold && p < alpha) {
+            verdict += " time";
+        }
+        if (memory_change > threshold) {
+            verdict += " memory";
+        }
+        if (allocation_change > threshold) {
+            verdict += " allocations";
+        }
+        if (quality_change > threshold) {
+            verdict += " quality";
+        }
+        regressed = regressed || !verdict.empty();
+
+        std::cout << std::left << std::setw(28) << now.name << std::right
+                << std::setprecision(4)
+                << std::setw(12) << median(base.samples)
+                << std::setw(12) << median(now.samples)
+                << std::setprecision(1)
+                << std::setw(9) << time_change * 100 << "%"
+                << std::setprecision(4)
+                << std::setw(10) << p
+                << std::setprecision(1)
+                << std::setw(9) << memory_change * 100 << "%"
+                << std::setw(9) << allocation_change * 100 << "%"
+                << std::setw(9) << quality_change * 100 << "%"
+                << "  " << (verdict.empty() ? "ok" : "REGRESSION:" + verdict) << "\n";
+    }
+    std::cout << (regressed ? "regressions found" : "no regressions") << std::endl;
+    return regressed ? regression_found : 0;
+}
+
+int main(int argc, char** argv) {
+    std::string mode;
+    std::string file;
+    unsigned repetitions = 7;
+    double threshold = 0.05;
+    double alpha = 0.01;
+
+    try {
+        if (argc < 3 || argc > 6) {
+            throw std::invalid_argument("wrong number of arguments");
+        }
+        mode = argv[1];
+        file = argv[2];
+        if (argc > 3) {
+            int value = std::stoi(argv[3]);
+            if (value < 2) {
+                throw std::invalid_argument("repetitions < 2");
+            }
+            repetitions = value;
+        }
+        if (argc > 4) {
+            threshold = std::stod(argv[4]) / 100;
+        }
+        if (argc > 5) {
+            alpha = std::stod(argv[5]);
+        }
+        if ((mode != "record" && mode != "compare")
+                || (mode == "record" && argc > 4) || threshold < 0 || alpha <= 0) {
+            throw std::invalid_argument("invalid value");
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "wrong arguments\n"
+                << "usage:\n"
+                << "\t" << argv[0] << " record [baseline.json] (repetitions=7)\n"
+                << "\t" << argv[0] << " compare [baseline.json] (repetitions=7) (threshold %=5) (alpha=0.01)\n"
+                << "compare exits with " << regression_found << " if a case is slower (significantly\n"
+                << "by the Mann-Whitney test and by more than the threshold), uses more memory\n"
+                << "or allocations or has worse quality than the threshold allows\n";
+        return 1;
+    }
+
+    try {
+        if (mode == "record") {
+            auto results = run_matrix(repetitions);
+            std::ofstream out(file);
+            write_baseline(out, results);
+            if (!out) {
+                throw std::runtime_error("cannot write '" + file + "'");
+            }
+            std::cout << "baseline written to " << file << std::endl;
+            return 0;
+        }
+        std::ifstream in(file);
+        if (!in) {
+            throw std::runtime_error("cannot read '" + file + "'");
+        }
+        demo::json_value json = demo::json_value::parse(in);
+        auto baseline = read_baseline(json);
+        demo::machine_info info = demo::machine_info::current();
+        const auto& machine = json.at("machine");
+        if (machine.at("cpu").string != info.cpu || machine.at("compiler").string != info.compiler) {
+            std::cerr << "warning: the baseline was recorded on a different machine or compiler\n";
+        }
+        auto current = run_matrix(repetitions);
+        return compare(baseline, current, threshold, alpha);
+    } catch (const std::exception& ex) {
+        std::cerr << "error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,564 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains an indexed container format for storing laid out
+ * dynamic graphs, which allows reading individual states without parsing
+ * the whole file.
+ *
+ * The states are stored in chunks, each protected by a checksum.
+ * A footer at the end of the file holds an index mapping every state
+ * to its position in the file. The states themselves are stored either in
+ * the text format (see parse.h) or in a compact binary encoding.
+ * Positions can be stored quantized (see quantization.h), in the binary
+ * encoding they then take up only as many bytes as needed by the grid.
+ *
+ * Layout of the file (all integers little-endian):
+ *   - header: magic "DYNGARC1", u32 size of the rest of the header, u32 encoding,
+ *     u32 quantization bits (0 if positions are not quantized),
+ *     f32 canvas width, f32 canvas height, f32 center x, f32 center y
+ *   - chunks of encoded states
+ *   - index: u32 state count, u32 chunk count,
+ *     for each chunk: u32 first state, u32 state count, u64 offset, u64 size, u64 checksum,
+ *     for each state: u64 offset, u32 size,
+ *     u64 checksum of the index
+ *   - trailer: u64 offset of the index, magic "DYNGARC1"
+ *
+ * @sa archive_writer,
+ * archive_reader
+ */
+#pragma once
+
+#include "dynamic_graph.h"
+#include "parse.h"
+#include "hash.h"
+#include "quantization.h"
+
+#include <ostream>
+#include <istream>
+#include <sstream> // std::stringstream
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring> // std::memcpy
+#include <algorithm> // std::min, std::upper_bound
+#include <iterator> // std::distance
+#include <stdexcept>
+#include <utility> // std::move
+
+namespace dyng {
+
+/// Encoding of graph states stored in an archive.
+enum class encoding : std::uint32_t {
+    /// the same text format as used by operator<< (see parse.h)
+    text,
+    /// a compact binary encoding of ids and coordinates
+    binary
+};
+
+namespace detail {
+
+constexpr char ArchiveMagic[] = "DYNGARC1";
+constexpr std::size_t ArchiveMagicSize = 8;
+constexpr std::size_t ArchiveTrailerSize = 8 + ArchiveMagicSize;
+
+inline void put_u32(std::string& buf, std::uint32_t value) {
+    for (unsigned i = 0; i < 4; ++i) {
+        buf += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+inline void put_u64(std::string& buf, std::uint64_t value) {
+    for (unsigned i = 0; i < 8; ++i) {
+        buf += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+inline void put_f32(std::string& buf, float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u32(buf, bits);
+}
+
+/// Reads little-endian values from a memory buffer.
+class byte_reader {
+public:
+    byte_reader(const char* data, std::size_t size)
+            : m_pos(data)
+            , m_end(data + size) {}
+
+    std::uint32_t u32() {
+        return static_cast<std::uint32_t>(read(4));
+    }
+
+    std::uint64_t u64() {
+        return read(8);
+    }
+
+    std::uint32_t uint(unsigned bytes) {
+        return static_cast<std::uint32_t>(read(bytes));
+    }
+
+    float f32() {
+        std::uint32_t bits = u32();
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+private:
+    const char* m_pos;
+    const char* m_end;
+
+    std::uint64_t read(unsigned bytes) {
+        if (static_cast<std::size_t>(m_end - m_pos) < bytes) {
+            throw std::runtime_error("archive data truncated");
+        }
+        std::uint64_t value = 0;
+        for (unsigned i = 0; i < bytes; ++i) {
+            value |= static_cast<std::uint64_t>(static_cast<unsigned char>(m_pos[i])) << (8 * i);
+        }
+        m_pos += bytes;
+        return value;
+    }
+};
+
+inline std::uint64_t checksum(const char* data, std::size_t size) {
+    fnv_hash hash;
+    hash.add(data, size);
+    return hash.value();
+}
+
+// returns the number of bytes used for a quantized coordinate
+inline unsigned quantized_bytes(const quantization& q) {
+    return (q.bits() + 7) / 8;
+}
+
+inline void put_uint(std::string& buf, std::uint32_t value, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i) {
+        buf += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+inline void encode_state(std::string& buf
+        , const graph_state& state
+        , encoding enc
+        , const quantization& q) {
+    if (enc == encoding::text) {
+        if (q.enabled()) {
+            append_quantized(buf, state, q);
+            return;
+        }
+        std::stringstream str;
+        str << state;
+        buf += str.str();
+        return;
+    }
+    put_u32(buf, state.nodes().size());
+    unsigned bytes = quantized_bytes(q);
+    for (const auto& n : state.nodes()) {
+        put_u32(buf, n.id().value);
+        if (q.enabled()) {
+            grid_coords cell = q.quantize(n.pos());
+            put_uint(buf, cell.x, bytes);
+            put_uint(buf, cell.y, bytes);
+        } else {
+            put_f32(buf, n.pos().x);
+            put_f32(buf, n.pos().y);
+        }
+    }
+    put_u32(buf, state.edges().size());
+    for (const auto& e : state.edges()) {
+        put_u32(buf, e.id().value);
+        put_u32(buf, e.one_id().value);
+        put_u32(buf, e.two_id().value);
+    }
+}
+
+inline graph_state decode_state(const char* data
+        , std::size_t size
+        , encoding enc
+        , const quantization& q) {
+    graph_state state;
+    if (enc == encoding::text) {
+        std::stringstream str(std::string(data, size));
+        str >> state;
+        return state;
+    }
+    byte_reader in(data, size);
+    std::uint32_t nodes = in.u32();
+    unsigned bytes = quantized_bytes(q);
+    for (std::uint32_t i = 0; i < nodes; ++i) {
+        auto& n = state.emplace_node(in.u32());
+        if (q.enabled()) {
+            n.pos().x = in.uint(bytes);
+            n.pos().y = in.uint(bytes);
+        } else {
+            n.pos().x = in.f32();
+            n.pos().y = in.f32();
+        }
+    }
+    std::uint32_t edges = in.u32();
+    for (std::uint32_t i = 0; i < edges; ++i) {
+        std::uint32_t id = in.u32();
+        std::uint32_t one = in.u32();
+        std::uint32_t two = in.u32();
+        state.emplace_edge(id, one, two);
+    }
+    return state;
+}
+
+/// Index entry describing a chunk of states in an archive.
+struct archive_chunk {
+    std::uint32_t first_state;
+    std::uint32_t state_count;
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::uint64_t checksum;
+};
+
+/// Index entry describing a single state in an archive.
+struct archive_state {
+    std::uint64_t offset;
+    std::uint32_t size;
+};
+
+} // namespace detail
+
+
+/// Writes a dynamic graph into the indexed archive format.
+/**
+ * (The format is described in archive.h)
+ *
+ * @sa archive_reader
+ */
+class archive_writer {
+public:
+    archive_writer() = default;
+
+    /// Sets the encoding of states and the number of states in one chunk.
+    explicit archive_writer(encoding enc, unsigned chunk_size = DefaultChunkSize)
+            : m_encoding(enc)
+            , m_chunk_size(chunk_size == 0 ? 1 : chunk_size) {}
+
+    void set_encoding(encoding enc) { m_encoding = enc; }
+
+    /// Sets the quantization of node positions.
+    /**
+     * By default positions are stored as they are. When a quantization is set,
+     * the stored positions are the grid coordinates, which are also what
+     * archive_reader returns.
+     *
+     * @sa quantization
+     */
+    void set_quantization(quantization q) { m_quantization = q; }
+
+    /// Sets the number of states stored in one chunk.
+    /**
+     * Smaller chunks make reading a few states cheaper, larger chunks make
+     * the index smaller. Default value is 64.
+     */
+    void set_chunk_size(unsigned size) { m_chunk_size = size == 0 ? 1 : size; }
+
+    /// Writes all states of @p dgraph into @p out.
+    /**
+     * The stream does not have to be seekable.
+     */
+    void write(std::ostream& out, const dynamic_graph& dgraph) const {
+        const auto& states = dgraph.states();
+        std::string header(detail::ArchiveMagic, detail::ArchiveMagicSize);
+        detail::put_u32(header, HeaderSize);
+        detail::put_u32(header, static_cast<std::uint32_t>(m_encoding));
+        detail::put_u32(header, m_quantization.bits());
+        detail::put_f32(header, m_quantization.canvas_width());
+        detail::put_f32(header, m_quantization.canvas_height());
+        detail::put_f32(header, m_quantization.center().x);
+        detail::put_f32(header, m_quantization.center().y);
+        out.write(header.data(), header.size());
+        std::uint64_t offset = header.size();
+
+        std::vector<detail::archive_chunk> chunks;
+        std::vector<detail::archive_state> index;
+        index.reserve(states.size());
+        std::string buf;
+        for (unsigned first = 0; first < states.size(); first += m_chunk_size) {
+            unsigned last = std::min<unsigned>(first + m_chunk_size, states.size());
+            buf.clear();
+            for (unsigned s = first; s < last; ++s) {
+                std::size_t start = buf.size();
+                detail::encode_state(buf, states[s], m_encoding, m_quantization);
+                index.push_back({ offset + start, static_cast<std::uint32_t>(buf.size() - start) });
+            }
+            chunks.push_back({ first, last - first, offset, buf.size(),
+                    detail::checksum(buf.data(), buf.size()) });
+            out.write(buf.data(), buf.size());
+            offset += buf.size();
+        }
+
+        buf.clear();
+        detail::put_u32(buf, states.size());
+        detail::put_u32(buf, chunks.size());
+        for (const auto& chunk : chunks) {
+            detail::put_u32(buf, chunk.first_state);
+            detail::put_u32(buf, chunk.state_count);
+            detail::put_u64(buf, chunk.offset);
+            detail::put_u64(buf, chunk.size);
+            detail::put_u64(buf, chunk.checksum);
+        }
+        for (const auto& entry : index) {
+            detail::put_u64(buf, entry.offset);
+            detail::put_u32(buf, entry.size);
+        }
+        detail::put_u64(buf, detail::checksum(buf.data(), buf.size()));
+        detail::put_u64(buf, offset);
+        buf.append(detail::ArchiveMagic, detail::ArchiveMagicSize);
+        out.write(buf.data(), buf.size());
+        if (!out.good()) {
+            throw std::runtime_error("archive could not be written");
+        }
+    }
+
+private:
+    static constexpr unsigned DefaultChunkSize = 64;
+    static constexpr unsigned HeaderSize = 24;
+
+    encoding m_encoding = encoding::binary;
+    unsigned m_chunk_size = DefaultChunkSize;
+    quantization m_quantization;
+};
+
+
+/// Reads individual states from an archive created by @ref archive_writer.
+/**
+ * Only the index is read when the object is constructed; states are loaded
+ * on demand. Every chunk that is read is verified against its checksum.
+ * The last chunk read is kept, so reading consecutive states one by one
+ * reads every chunk only once.
+ *
+ * The stream has to be seekable and has to outlive this object.
+ *
+ * @sa archive_writer
+ */
+class archive_reader {
+public:
+    /// Reads the index of the archive.
+    /**
+     * @throw std::runtime_error If the stream does not contain a valid archive.
+     */
+    explicit archive_reader(std::istream& in)
+            : m_in(in) {
+        read_index();
+    }
+
+    /// Returns the number of states stored in the archive.
+    unsigned state_count() const { return m_states.size(); }
+
+    /// Returns the encoding used for the stored states.
+    encoding get_encoding() const { return m_encoding; }
+
+    /// Returns the quantization of stored positions.
+    /**
+     * If quantization::enabled() is true, positions of read states
+     * are grid coordinates, unless set_restore_positions(true) is used.
+     */
+    const quantization& get_quantization() const { return m_quantization; }
+
+    /// Switches whether quantized positions are mapped back to the canvas when read.
+    /**
+     * Off by default, read states then hold the grid coordinates as stored.
+     * Has no effect if the archive isn't quantized.
+     *
+     * @sa restore_positions
+     */
+    void set_restore_positions(bool value) { m_restore_positions = value; }
+
+    /// Reads a single state.
+    /**
+     * @throw std::out_of_range If @p index >= state_count().
+     * @throw std::runtime_error If the data is corrupted.
+     */
+    graph_state state(unsigned index) {
+        if (index >= state_count()) {
+            throw std::out_of_range("state index out of range");
+        }
+        const auto& chunk = load_chunk(index);
+        const auto& entry = m_states[index];
+        if (entry.offset < chunk.offset
+                || entry.offset + entry.size > chunk.offset + chunk.size) {
+            throw std::runtime_error("invalid archive index");
+        }
+        graph_state result = detail::decode_state(m_chunk_data.data() + (entry.offset - chunk.offset),
+                entry.size, m_encoding, m_quantization);
+        if (m_restore_positions && m_quantization.enabled()) {
+            restore_positions(result, m_quantization);
+        }
+        return result;
+    }
+
+    /// Reads states in the range [first, last).
+    /**
+     * @throw std::out_of_range If first > last or last > state_count().
+     * @throw std::runtime_error If the data is corrupted.
+     */
+    std::vector<graph_state> states(unsigned first, unsigned last) {
+        if (first > last || last > state_count()) {
+            throw std::out_of_range("invalid range of states");
+        }
+        std::vector<graph_state> result;
+        result.reserve(last - first);
+        for (unsigned s = first; s < last; ++s) {
+            result.push_back(state(s));
+        }
+        return result;
+    }
+
+    /// Builds @p dgraph from states in the range [first, last).
+    /**
+     * Elements present in the first loaded state are not marked as new
+     * and elements present in the last loaded state are not marked as old,
+     * even if they are in the whole sequence.
+     *
+     * @sa dynamic_graph::build(std::vector<graph_state>)
+     */
+    void load(dynamic_graph& dgraph, unsigned first, unsigned last) {
+        dgraph.build(states(first, last));
+    }
+
+private:
+    std::istream& m_in;
+    encoding m_encoding = encoding::binary;
+    quantization m_quantization;
+    bool m_restore_positions = false;
+    std::vector<detail::archive_chunk> m_chunks;
+    std::vector<detail::archive_state> m_states;
+    // currently loaded chunk
+    unsigned m_chunk = 0;
+    bool m_chunk_loaded = false;
+    std::string m_chunk_data;
+
+    std::string read_at(std::uint64_t offset, std::uint64_t size) {
+        std::string result(size, '\0');
+        m_in.clear();
+        m_in.seekg(offset);
+        m_in.read(&result[0], size);
+        if (!m_in || static_cast<std::uint64_t>(m_in.gcount()) != size) {
+            throw std::runtime_error("archive data truncated");
+        }
+        return result;
+    }
+
+    void read_index() {
+        m_in.clear();
+        m_in.seekg(0, std::ios::end);
+        std::uint64_t file_size = m_in.tellg();
+        std::size_t prefix_size = detail::ArchiveMagicSize + 4;
+        if (!m_in || file_size < prefix_size + detail::ArchiveTrailerSize) {
+            throw std::runtime_error("not an archive");
+        }
+        std::string prefix = read_at(0, prefix_size);
+        std::string trailer = read_at(file_size - detail::ArchiveTrailerSize,
+                detail::ArchiveTrailerSize);
+        if (prefix.compare(0, detail::ArchiveMagicSize, detail::ArchiveMagic) != 0
+                || trailer.compare(8, detail::ArchiveMagicSize, detail::ArchiveMagic) != 0) {
+            throw std::runtime_error("not an archive");
+        }
+        std::uint32_t header_size = detail::byte_reader(prefix.data() + detail::ArchiveMagicSize,
+                4).u32();
+        if (header_size > file_size - prefix_size) {
+            throw std::runtime_error("not an archive");
+        }
+        std::string header = read_at(prefix_size, header_size);
+        detail::byte_reader header_in(header.data(), header.size());
+        std::uint32_t enc = header_in.u32();
+        if (enc > static_cast<std::uint32_t>(encoding::binary)) {
+            throw std::runtime_error("unknown archive encoding");
+        }
+        m_encoding = static_cast<encoding>(enc);
+        std::uint32_t bits = header_in.u32();
+        if (bits != 0) {
+            float width = header_in.f32();
+            float height = header_in.f32();
+            coords center;
+            center.x = header_in.f32();
+            center.y = header_in.f32();
+            try {
+                m_quantization = quantization(bits, width, height, center);
+            } catch (const std::invalid_argument&) {
+                throw std::runtime_error("invalid archive quantization");
+            }
+        }
+
+        std::uint64_t index_offset = detail::byte_reader(trailer.data(), 8).u64();
+        std::uint64_t index_end = file_size - detail::ArchiveTrailerSize;
+        if (index_offset > index_end || index_end - index_offset < 8) {
+            throw std::runtime_error("invalid archive index");
+        }
+        std::string index = read_at(index_offset, index_end - index_offset);
+        std::size_t checked = index.size() - 8;
+        if (detail::byte_reader(index.data() + checked, 8).u64()
+                != detail::checksum(index.data(), checked)) {
+            throw std::runtime_error("archive index checksum mismatch");
+        }
+        detail::byte_reader in(index.data(), checked);
+        std::uint32_t state_count = in.u32();
+        std::uint32_t chunk_count = in.u32();
+        // the counts come from the file, they are checked before reserving memory for them
+        if (chunk_count * std::uint64_t(32) + state_count * std::uint64_t(12) != checked - 8) {
+            throw std::runtime_error("invalid archive index");
+        }
+        m_chunks.reserve(chunk_count);
+        for (std::uint32_t i = 0; i < chunk_count; ++i) {
+            detail::archive_chunk chunk;
+            chunk.first_state = in.u32();
+            chunk.state_count = in.u32();
+            chunk.offset = in.u64();
+            chunk.size = in.u64();
+            chunk.checksum = in.u64();
+            m_chunks.push_back(chunk);
+        }
+        m_states.reserve(state_count);
+        for (std::uint32_t i = 0; i < state_count; ++i) {
+            detail::archive_state entry;
+            entry.offset = in.u64();
+            entry.size = in.u32();
+            m_states.push_back(entry);
+        }
+    }
+
+    const detail::archive_chunk& load_chunk(unsigned state) {
+        auto found = std::upper_bound(m_chunks.begin(), m_chunks.end(), state,
+                [](unsigned s, const detail::archive_chunk& c){ return s < c.first_state; });
+        if (found == m_chunks.begin()) {
+            throw std::runtime_error("invalid archive index");
+        }
+        unsigned index = std::distance(m_chunks.begin(), found) - 1;
+        const auto& chunk = m_chunks[index];
+        if (m_chunk_loaded && m_chunk == index) {
+            return chunk;
+        }
+        m_chunk_loaded = false;
+        m_chunk_data = read_at(chunk.offset, chunk.size);
+        if (detail::checksum(m_chunk_data.data(), m_chunk_data.size()) != chunk.checksum) {
+            throw std::runtime_error("archive chunk checksum mismatch");
+        }
+        m_chunk = index;
+        m_chunk_loaded = true;
+        return chunk;
+    }
+};
+
+} // namespace dyng
@@ -0,0 +1,86 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains a function that lays out many dynamic graphs at once,
+ * each graph being a single task.
+ *
+ * @sa layout_batch
+ */
+#pragma once
+
+#include "dynamic_graph.h"
+#include "executor.h"
+
+#include <vector>
+#include <atomic>
+#include <algorithm> // std::stable_sort
+#include <numeric> // std::iota
+#include <cstdint>
+
+namespace dyng {
+
+/// Performs a layout algorithm on every graph of a vector.
+/**
+ * Useful for many small graphs, where splitting the work on a single graph
+ * between threads doesn't pay off. Whole graphs are distributed between
+ * the threads of @p exec, largest first, so that a large graph taken last
+ * doesn't keep a single thread busy at the end.
+ *
+ * Every thread works with its own copy of @p layout, which is reused for all
+ * graphs the thread takes, so the buffers of the layout are allocated only
+ * once per thread. The results are the same as if @p layout was called
+ * on every graph in turn, as long as it gives the same results when reused.
+ *
+ * @tparam Layout A layout object such as @ref default_layout.
+ * @throw The first exception thrown by the layout; graphs not yet taken by then are left unchanged.
+ */
+template<typename Layout>
+void layout_batch(std::vector<dynamic_graph>& graphs
+        , const Layout& layout
+        , const executor& exec = executor::shared()) {
+    // the work on a graph grows with the number of nodes and edges in all its states
+    std::vector<std::uint64_t> sizes(graphs.size(), 0);
+    for (unsigned g = 0; g < graphs.size(); ++g) {
+        for (const auto& state : graphs[g].states()) {
+            sizes[g] += state.nodes().size() + state.edges().size();
+        }
+    }
+    std::vector<unsigned> order(graphs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sizes](unsigned a, unsigned b){
+        return sizes[a] > sizes[b];
+    });
+
+    auto& pool = exec.pool();
+    std::atomic<unsigned> next{ 0 };
+    std::atomic<bool> failed{ false };
+    pool.for_each([&](unsigned){
+        Layout local = layout;
+        unsigned index;
+        while (!failed && (index = next++) < order.size()) {
+            try {
+                local(graphs[order[index]]);
+            } catch (...) {
+                failed = true;
+                throw;
+            }
+        }
+    });
+}
+
+} // namespace dyng
@@ -0,0 +1,54 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "exceptions.h"
+
+#include <atomic>
+#include <memory> // std::shared_ptr
+
+namespace dyng {
+
+/// A flag used to cancel a running or queued layout computation.
+/**
+ * Copies share the same flag, so one copy is given to the computation
+ * and another one is kept to cancel it.
+ *
+ * @sa foresighted_layout::async,
+ * layout_cancelled
+ */
+class cancellation_token {
+public:
+    cancellation_token()
+            : m_flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+    /// Requests cancellation; the computation stops at the next check.
+    void cancel() { *m_flag = true; }
+
+    bool cancelled() const { return *m_flag; }
+
+    /// Throws layout_cancelled if cancellation has been requested.
+    void check() const {
+        if (cancelled()) {
+            throw layout_cancelled();
+        }
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_flag;
+};
+
+} // namespace dyng
@@ -0,0 +1,227 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains an observer that records how a layout converges,
+ * iteration by iteration, and functions to analyse the recording.
+ *
+ * @sa convergence_recorder
+ */
+#pragma once
+
+#include "observer.h"
+#include "cooling.h"
+
+#include <vector>
+#include <mutex>
+#include <memory> // std::shared_ptr
+#include <ostream>
+#include <cmath> // std::pow, std::abs
+#include <algorithm> // std::max
+#include <cstdint>
+
+namespace dyng {
+
+/// One row of a convergence trace.
+struct convergence_row {
+    /// Either layout_phase::static_pass or layout_phase::tolerance_round.
+    layout_phase phase;
+    /// The index of the static pass (counted from 0 since the recorder was cleared); 0 in tolerance.
+    unsigned pass;
+    /// The iteration within the pass, or the round of tolerance.
+    unsigned iteration;
+    float temperature;
+    /// Energy of the layout, summed over all states in tolerance.
+    double energy;
+    double mean_displacement;
+    double max_displacement;
+    /// The fraction of states accepted in a round of tolerance; -1 in static passes.
+    double acceptance;
+};
+
+/// Observer that records the energy and displacements of every iteration.
+/**
+ * Every iteration of a static pass is a row of the trace; in tolerance,
+ * the iterations of all states in a round are summed into one row, together
+ * with the fraction of accepted states.
+ *
+ * The same recorder has to be set as the observer of the layout and of its
+ * static layout; copies share the same recording. Recording slows the layout
+ * down, because every iteration takes an extra pass over the nodes and a lock.
+ * The process layout only records the static layout, as tolerance runs in other processes.
+ *
+ * For example:
+ *
+ *     dyng::convergence_recorder trace;
+ *     dyng::foresighted_layout<
+ *             dyng::fruchterman_reingold<dyng::initial_placement, dyng::convergence_recorder>,
+ *             dyng::convergence_recorder> layout(0.1, 1, 1);
+ *     layout.set_observer(trace);
+ *     layout.static_layout().set_observer(trace);
+ *     layout(dgraph);
+ *     trace.write_csv(std::cout);
+ */
+class convergence_recorder {
+public:
+    static constexpr bool enabled = true;
+    static constexpr bool samples_iterations = true;
+
+    convergence_recorder()
+            : m_state(std::make_shared<state>()) {}
+
+    void begin(layout_phase p) {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (p == layout_phase::static_pass) {
+            ++m_state->passes;
+            m_state->iteration = 0;
+        } else if (p == layout_phase::tolerance_round) {
+            m_state->in_round = true;
+            m_state->round = iteration_sample();
+            m_state->accepted = 0;
+            m_state->rejected = 0;
+        }
+    }
+
+    void end(layout_phase p, double, unsigned) {
+        if (p != layout_phase::tolerance_round) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        const auto& r = m_state->round;
+        std::uint64_t decided = m_state->accepted + m_state->rejected;
+        m_state->rows.push_back(convergence_row{ p, 0, m_state->rounds++, r.temperature, r.energy,
+                r.nodes > 0 ? r.displacement / r.nodes : 0, r.max_displacement,
+                decided > 0 ? static_cast<double>(m_state->accepted) / decided : 0 });
+        m_state->in_round = false;
+    }
+
+    void count(layout_counter c, std::uint64_t value) {
+        if (c != layout_counter::accepted && c != layout_counter::rejected) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        (c == layout_counter::accepted ? m_state->accepted : m_state->rejected) += value;
+    }
+
+    void sample(const iteration_sample& s) {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (m_state->in_round) {
+            auto& r = m_state->round;
+            r.temperature = s.temperature;
+            r.energy += s.energy;
+            r.displacement += s.displacement;
+            r.max_displacement = std::max(r.max_displacement, s.max_displacement);
+            r.nodes += s.nodes;
+            return;
+        }
+        unsigned pass = m_state->passes > 0 ? m_state->passes - 1 : 0;
+        m_state->rows.push_back(convergence_row{ layout_phase::static_pass, pass,
+                m_state->iteration++, s.temperature, s.energy,
+                s.nodes > 0 ? s.displacement / s.nodes : 0, s.max_displacement, -1 });
+    }
+
+    /// Returns a copy of the recorded rows.
+    std::vector<convergence_row> rows() const {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        return m_state->rows;
+    }
+
+    /// Returns the rows of one static pass, or of tolerance if @p phase is tolerance_round.
+    std::vector<convergence_row> rows(layout_phase phase, unsigned pass = 0) const {
+        std::vector<convergence_row> result;
+        for (const auto& r : rows()) {
+            if (r.phase == phase && r.pass == pass) {
+                result.push_back(r);
+            }
+        }
+        return result;
+    }
+
+    /// Removes all rows and starts counting passes and rounds from 0.
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->rows.clear();
+        m_state->passes = 0;
+        m_state->iteration = 0;
+        m_state->rounds = 0;
+        m_state->in_round = false;
+    }
+
+    /// Writes the rows as CSV with a header.
+    void write_csv(std::ostream& out) const {
+        out << "phase,pass,iteration,temperature,energy,mean_displacement,max_displacement,acceptance\n";
+        for (const auto& r : rows()) {
+            out << (r.phase == layout_phase::static_pass ? "static" : "tolerance") << ","
+                    << r.pass << "," << r.iteration << "," << r.temperature << ","
+                    << r.energy << "," << r.mean_displacement << ","
+                    << r.max_displacement << "," << r.acceptance << "\n";
+        }
+    }
+
+private:
+    struct state {
+        mutable std::mutex mutex;
+        std::vector<convergence_row> rows;
+        unsigned passes = 0;
+        unsigned iteration = 0;
+        unsigned rounds = 0;
+        bool in_round = false;
+        iteration_sample round;
+        std::uint64_t accepted = 0;
+        std::uint64_t rejected = 0;
+    };
+
+    std::shared_ptr<state> m_state;
+};
+
+
+/// Returns the number of iterations after which the energy stays close to its final value.
+/**
+ * That is the smallest n such that the energy of every iteration from n - 1 on
+ * differs from the energy of the last one by at most @p tolerance times the latter.
+ */
+inline unsigned settled_iterations(const std::vector<convergence_row>& rows, double tolerance) {
+    if (rows.empty()) {
+        return 0;
+    }
+    double last = rows.back().energy;
+    double band = std::abs(last) * tolerance;
+    unsigned first = rows.size() - 1;
+    while (first > 0 && std::abs(rows[first - 1].energy - last) <= band) {
+        --first;
+    }
+    return first + 1;
+}
+
+/// Returns a geometric cooling with @p iterations iterations over the same temperatures as @p original.
+/**
+ * The start temperature is the same and the temperature after the last
+ * iteration is the same as in @p original; only the annealing is faster.
+ */
+inline cooling shortened_cooling(const cooling& original, unsigned iterations) {
+    iterations = std::max(iterations, 1u);
+    float end = original.start_temperature;
+    for (unsigned i = 0; i < original.iterations; ++i) {
+        end = original.anneal(end);
+    }
+    float factor = original.start_temperature > 0
+            ? static_cast<float>(std::pow(end / original.start_temperature, 1.0 / iterations))
+            : 1.0f;
+    return cooling(iterations, original.start_temperature, [factor](float t){ return t * factor; });
+}
+
+} // namespace dyng
@@ -33,6 +33,21 @@ struct cooling {
             : iterations(iterations)
             , start_temperature(start_temperature)
             , anneal(std::move(anneal)) {}
+
+    /// Adds the cooling to a hash.
+    /**
+     * The annealing function can't be compared directly, so the whole sequence
+     * of temperatures it produces is hashed instead.
+     */
+    template<typename Hasher>
+    void hash_parameters(Hasher& hasher) const {
+        hasher.add(iterations);
+        float temperature = start_temperature;
+        for (unsigned i = 0; i < iterations; ++i) {
+            hasher.add(temperature);
+            temperature = anneal(temperature);
+        }
+    }
 };
 
 } // namespace dyng
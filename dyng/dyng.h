@@ -22,6 +22,7 @@
  * 
  * @sa dyng::default_layout
  * dyng::default_layout_parallel
+ * dyng::default_layout_process
  */
 
 #pragma once
@@ -29,9 +30,20 @@
 #include "dynamic_graph.h"
 #include "interpolator.h"
 #include "parse.h"
+#include "quantization.h"
+#include "archive.h"
+#include "import.h"
+#include "layout_cache.h"
+#include "batch.h"
 
 #include "foresighted_layout.h"
 #include "foresighted_parallel.h"
+#include "foresighted_process.h"
+#include "executor.h"
+#include "observer.h"
+#include "trace.h"
+#include "metrics.h"
+#include "convergence.h"
 #include "fruchterman_reingold.h"
 #include "initial_placement.h"
 
@@ -59,4 +71,14 @@ using default_layout = foresighted_layout<fruchterman_reingold<initial_placement
 using default_layout_parallel = parallel_foresighted_layout
         <fruchterman_reingold<initial_placement>>;
 
+/**
+ * The same algorithms as @ref default_layout_parallel, but tolerance runs
+ * in multiple processes using @ref process_foresighted_layout.
+ * 
+ * @sa dyng::process_foresighted_layout,
+ * dyng::default_layout_parallel
+ */
+using default_layout_process = process_foresighted_layout
+        <fruchterman_reingold<initial_placement>>;
+
 } // namespace dyng
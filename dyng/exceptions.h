@@ -18,7 +18,8 @@
  * 
  * Contains definitions for the exception used by the library.
  * 
- * @sa invalid_graph
+ * @sa invalid_graph,
+ * layout_cancelled
  */
 
 #pragma once
@@ -48,4 +49,13 @@ private:
     std::string m_msg;
 };
 
+/**
+ * This exception is thrown by a layout object if its computation
+ * was cancelled using a @ref cancellation_token.
+ */
+class layout_cancelled : public std::exception {
+public:
+    const char* what() const noexcept override { return "layout cancelled"; }
+};
+
 } // namespace dyng
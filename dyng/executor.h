@@ -0,0 +1,129 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "parallel.h"
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <algorithm> // std::max
+
+namespace dyng {
+
+/// A handle to a thread pool that can be shared by multiple layout objects.
+/**
+ * Copies of an executor refer to the same pool, which lives as long as any of them.
+ * Layout objects constructed with the same executor can be used concurrently
+ * from different threads; their work is scheduled on the same worker threads,
+ * so the machine is not oversubscribed.
+ *
+ * Jobs of concurrent callers are queued in the order they arrive and workers
+ * regularly take new jobs before continuing with the one they work on,
+ * so a long job does not starve short ones.
+ *
+ * A thread that calls into the pool (e.g. by laying out a graph with
+ * a parallel layout) doesn't block while waiting; it executes tasks too,
+ * like one of the workers. The pool has threads() - 1 worker threads, so with
+ * N concurrent callers up to threads() - 1 + N threads work at the same time.
+ * The thread count therefore limits the worker threads, not the callers.
+ *
+ * For the pool shared by the whole process use shared().
+ *
+ * @sa parallel_foresighted_layout
+ */
+class executor {
+public:
+    /// Creates a new pool with a given number of threads.
+    /**
+     * The thread waiting for a job counts as one of them (see detail::parallel).
+     *
+     * @throw std::invalid_argument If @p threads is 0.
+     */
+    explicit executor(unsigned threads, detail::wait_policy policy = detail::wait_policy::spin)
+            : m_pool(std::make_shared<detail::parallel>(threads, policy)) {}
+
+    /// Returns the process-wide executor.
+    /**
+     * It is created on first use, with the thread count set by set_shared_threads,
+     * or the number of hardware threads by default.
+     */
+    static executor shared() {
+        std::lock_guard<std::mutex> lock(shared_state().mutex);
+        auto& state = shared_state();
+        if (!state.pool) {
+            unsigned threads = state.threads;
+            if (threads == 0) {
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            state.pool = std::make_shared<detail::parallel>(threads);
+        }
+        return executor(state.pool);
+    }
+
+    /// Sets the number of threads of the process-wide executor.
+    /**
+     * Together with the threads calling into it, this limits the threads used
+     * by all users of the shared executor (see the class description).
+     *
+     * @throw std::logic_error If the shared executor has already been created.
+     */
+    static void set_shared_threads(unsigned threads) {
+        std::lock_guard<std::mutex> lock(shared_state().mutex);
+        if (shared_state().pool) {
+            throw std::logic_error("the shared executor is already running");
+        }
+        shared_state().threads = threads;
+    }
+
+    /// Returns the number of threads, including the calling thread.
+    unsigned threads() const { return m_pool->count(); }
+
+    /// Returns true if this refers to the process-wide executor.
+    bool is_shared() const {
+        std::lock_guard<std::mutex> lock(shared_state().mutex);
+        return m_pool == shared_state().pool;
+    }
+
+    /// Pins the worker threads to CPUs, see detail::parallel::pin_threads.
+    bool pin_threads() const { return m_pool->pin_threads(); }
+
+    /// Returns the underlying pool.
+    detail::parallel& pool() const { return *m_pool; }
+
+    bool operator==(const executor& other) const { return m_pool == other.m_pool; }
+    bool operator!=(const executor& other) const { return m_pool != other.m_pool; }
+
+private:
+    struct shared_executor {
+        std::mutex mutex;
+        std::shared_ptr<detail::parallel> pool;
+        unsigned threads = 0;
+    };
+
+    std::shared_ptr<detail::parallel> m_pool;
+
+    explicit executor(std::shared_ptr<detail::parallel> pool)
+            : m_pool(std::move(pool)) {}
+
+    static shared_executor& shared_state() {
+        static shared_executor state;
+        return state;
+    }
+};
+
+} // namespace dyng
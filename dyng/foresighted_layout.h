@@ -19,16 +19,66 @@
 #include "mapped_graph.h"
 #include "dynamic_graph.h"
 #include "cooling.h"
+#include "task_graph.h"
+#include "executor.h"
+#include "cancellation.h"
+#include "observer.h"
+#include "metrics.h" // mental_distance
 
 #include <vector>
+#include <future>
+#include <thread>
+#include <memory> // std::shared_ptr
+#include <exception> // std::exception_ptr
 #include <unordered_map>
 #include <unordered_set>
 #include <cmath>
+#include <cstring> // std::strlen
 #include <utility> // std::move
-#include <algorithm> // std::max_element
+#include <algorithm> // std::max_element, std::min, std::count
 
 namespace dyng {
 
+/// Refers to a job started by foresighted_layout::async.
+/**
+ * Like the future returned by std::async, destroying the handle waits
+ * for the job, so a job never outlives the handle of its caller.
+ */
+class async_handle {
+public:
+    async_handle() = default;
+
+    explicit async_handle(std::thread thread) : m_thread(std::move(thread)) {}
+    explicit async_handle(std::future<void> done) : m_done(std::move(done)) {}
+
+    async_handle(async_handle&&) = default;
+
+    async_handle& operator=(async_handle&& other) {
+        wait();
+        m_thread = std::move(other.m_thread);
+        m_done = std::move(other.m_done);
+        return *this;
+    }
+
+    ~async_handle() { wait(); }
+
+    /// Waits until the job, including its callback, has finished.
+    void wait() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        if (m_done.valid()) {
+            m_done.get();
+        }
+    }
+
+private:
+    // the thread running the job if the executor has no worker threads
+    std::thread m_thread;
+    // ready when a job posted to the executor has finished
+    std::future<void> m_done;
+};
+
 /**
  * An implementation of the Foresighted Layout with Tolerance algorithm.
  * Used as a function object. Uses Layout to create a static layout of
@@ -39,12 +89,15 @@ namespace dyng {
  * 
  * @tparam StaticLayout Function object that creates static layout and
  * also can be applied as singular iterations to improve the layouts.
+ * Iterations use buffers of type 'StaticLayout::workspace'.
+ * @tparam Observer Receives the phases and counters of the computation,
+ * see @ref no_observer.
  * 
  * @sa dyng::dynamic_graph,
  * dyng.h
  */
 
-template <typename StaticLayout>
+template <typename StaticLayout, typename Observer = no_observer>
 class foresighted_layout {
 
 using node_live_sets = std::unordered_map<node_id, detail::live_set>;
@@ -83,6 +136,15 @@ public:
         m_center = center;
     }
 
+    /// Returns the width of the canvas.
+    float canvas_width() const { return m_canvas_width; }
+
+    /// Returns the height of the canvas.
+    float canvas_height() const { return m_canvas_height; }
+
+    /// Returns the center point of the canvas.
+    coords center() const { return m_center; }
+
     void set_tolerance(float tolerance) { m_tolerance = tolerance; }
 
     /// Sets whether to use relative or absolute mental distance calculations.
@@ -100,30 +162,209 @@ public:
     /// Sets a different cooling strategy.
     void set_cooling(cooling c) { m_cooling = std::move(c); }
 
+    /// Returns the cooling strategy of tolerance.
+    const cooling& tolerance_cooling() const { return m_cooling; }
+
+    /// Adds all parameters that affect the resulting layout to a hash.
+    /**
+     * The variant of the algorithm (serial, parallel or process) is included,
+     * because their results differ.
+     * Requires StaticLayout to have a method with the same signature.
+     *
+     * @sa layout_cache
+     */
+    template<typename Hasher>
+    void hash_parameters(Hasher& hasher) const {
+        const char* variant = kind();
+        hasher.add(variant, std::strlen(variant));
+        hasher.add(m_tolerance);
+        hasher.add(m_canvas_width);
+        hasher.add(m_canvas_height);
+        hasher.add(m_center.x);
+        hasher.add(m_center.y);
+        hasher.add(m_relative_distance);
+        m_cooling.hash_parameters(hasher);
+        m_static_layout.hash_parameters(hasher);
+    }
+
     /// Performs the algorithm on a dynamic graph.
     void operator()(dynamic_graph& dgraph) {
         if (dgraph.states().empty()) {
             return;
         }
+        auto& states = dgraph.states();
         // scale calculation canvas size to ratio
         float calculation_h = CalculationHeight;
         float calculation_w = calculation_h * m_canvas_width / m_canvas_height;
 
-        // calculate using basic Foresighted Layout 
-        basic_layout(dgraph.states(), calculation_w, calculation_h);
+        // the stages of the algorithm and their dependencies,
+        // independent stages run at the same time when a pool is available
+        detail::task_graph stages;
+        // cancellation is checked before every stage
+        auto checked = [this](layout_phase p, auto func){
+            return [this, p, func](){
+                m_cancel.check();
+                detail::scoped_phase<Observer> scope(m_observer, p);
+                func();
+            };
+        };
+        node_live_sets nodes_live;
+        edge_live_sets edges_live;
+        graph_state supergraph;
+        detail::mapped_graph gap;
+        detail::mapped_graph rgap;
+
+        // calculate using basic Foresighted Layout
+        auto node_live = stages.add("node live times", checked(layout_phase::node_live_times, [&](){
+            nodes_live = node_live_times(states);
+        }));
+        auto edge_live = stages.add("edge live times", checked(layout_phase::edge_live_times, [&](){
+            edges_live = edge_live_times(states);
+        }));
+        auto super = stages.add("supergraph", checked(layout_phase::supergraph, [&](){
+            supergraph = calculate_supergraph(states);
+        }));
+        auto gap_stage = stages.add("gap", checked(layout_phase::gap, [&](){
+            gap = calculate_gap(supergraph, nodes_live, edges_live);
+        }), { node_live, edge_live, super });
+        auto rgap_stage = stages.add("rgap", checked(layout_phase::rgap, [&](){
+            rgap = calculate_rgap(std::move(gap));
+        }), { gap_stage });
+        auto static_stage = stages.add("static layout", checked(layout_phase::static_layout, [&](){
+            static_layout_pass(rgap.graph(), calculation_w, calculation_h, stage_pool(), 0);
+        }), { rgap_stage });
+        auto last = stages.add("positions", checked(layout_phase::positions, [&](){
+            use_positions(states, rgap);
+        }), { static_stage });
 
         // improve resulting layouts within tolerance
         if (m_tolerance != 0) {
-            tolerance(dgraph.states(), calculation_w, calculation_h, m_tolerance);
+            last = stages.add("tolerance", checked(layout_phase::tolerance, [&](){
+                tolerance(states, calculation_w, calculation_h, m_tolerance);
+            }), { last });
+        }
+
+        // rescale to required dimensions, states are independent
+        detail::parallel* pool = stage_pool();
+        unsigned parts = pool ? std::min<unsigned>(pool->count(), states.size()) : 1;
+        for (unsigned p = 0; p < parts; ++p) {
+            stages.add("rescale", checked(layout_phase::rescale, [&, p, parts](){
+                for (unsigned s = p; s < states.size(); s += parts) {
+                    rescale(states[s], calculation_w, calculation_h,
+                            m_canvas_width, m_canvas_height);
+                    move(states[s], 0.0, 0.0, m_center.x, m_center.y);
+                }
+            }), { last });
+        }
+        stages.run(pool);
+        m_stage_timings = stages.timings();
+    }
+
+    /// Sets a token that can be used to cancel computations of this object.
+    /**
+     * Cancellation is checked between the stages of the algorithm and in every
+     * round of tolerance; the computation then throws @ref layout_cancelled
+     * and the graph is left in an unspecified state.
+     */
+    void set_cancellation(cancellation_token token) { m_cancel = std::move(token); }
+
+    /// Computes the layout of a graph asynchronously.
+    /**
+     * The job is queued on the executor (see get_executor) and uses a copy
+     * of this object, so this object can be changed or destroyed meanwhile.
+     * The returned future holds the laid out graph, or the exception thrown
+     * by the computation, e.g. @ref layout_cancelled if @p token was cancelled.
+ * If the executor has no worker threads (threads() == 1), the job runs
+     * on a new thread; as with std::async, destroying the future then waits for it.
+     *
+     * For example:
+     *
+     *     dyng::cancellation_token token;
+     *     auto result = layout.async(std::move(dgraph), token);
+     *     ...
+     *     token.cancel(); // if the result is not needed anymore
+     */
+    std::future<dynamic_graph> async(dynamic_graph dgraph
+            , cancellation_token token = cancellation_token()) const {
+        std::shared_ptr<foresighted_layout> layout = clone();
+        layout->m_cancel = std::move(token);
+        executor exec = get_executor();
+        if (exec.threads() == 1) {
+            // the pool has no worker threads that would execute a posted job;
+            // the future of std::async joins its thread when it is destroyed
+            return std::async(std::launch::async, [layout, dgraph = std::move(dgraph)]() mutable {
+                (*layout)(dgraph);
+                return std::move(dgraph);
+            });
         }
+        auto promise = std::make_shared<std::promise<dynamic_graph>>();
+        auto result = promise->get_future();
+        exec.pool().post([layout, promise, dgraph = std::move(dgraph)]() mutable {
+            try {
+                (*layout)(dgraph);
+                promise->set_value(std::move(dgraph));
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return result;
+    }
 
-        // rescale to required dimensions
-        for (auto& state : dgraph.states()) {
-            rescale(state, calculation_w, calculation_h, m_canvas_width, m_canvas_height);
-            move(state, 0.0, 0.0, m_center.x, m_center.y);
+    /// Computes the layout of a graph asynchronously and calls a function when it's done.
+    /**
+     * The callback is called from a thread of the executor and must not throw.
+     * If the executor has no worker threads (threads() == 1), the job runs
+     * on a new thread owned by the returned handle instead, so this never
+     * blocks the caller. Destroying the handle waits for the job.
+     * Expected signature: 'void(std::exception_ptr error, dyng::dynamic_graph& result)',
+     * where @p error is null on success.
+     */
+    template<typename Callback>
+    async_handle async(dynamic_graph dgraph
+            , Callback callback
+            , cancellation_token token = cancellation_token()) const {
+        std::shared_ptr<foresighted_layout> layout = clone();
+        layout->m_cancel = std::move(token);
+        executor exec = get_executor();
+        auto job = [layout, callback, dgraph = std::move(dgraph)]() mutable {
+            std::exception_ptr error;
+            try {
+                (*layout)(dgraph);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            callback(error, dgraph);
+        };
+        if (exec.threads() == 1) {
+            // the pool has no worker threads that would execute a posted job
+            return async_handle(std::thread(std::move(job)));
         }
+        auto done = std::make_shared<std::promise<void>>();
+        async_handle handle(done->get_future());
+        exec.pool().post([job = std::move(job), done]() mutable {
+            job();
+            done->set_value();
+        });
+        return handle;
     }
 
+    /// Returns the executor used by async; the process-wide one by default.
+    virtual executor get_executor() const { return executor::shared(); }
+
+    /// Sets the observer of the computation.
+    void set_observer(Observer observer) { m_observer = std::move(observer); }
+
+    const Observer& observer() const { return m_observer; }
+    Observer& observer() { return m_observer; }
+
+    /// Returns the time spent in every stage of the last layout computed by this object.
+    /**
+     * The stages are "node live times", "edge live times", "supergraph", "gap",
+     * "rgap", "static layout", "positions", "tolerance" (if tolerance is not 0)
+     * and "rescale".
+     */
+    const std::vector<stage_timing>& stage_timings() const { return m_stage_timings; }
+
 protected:
     static constexpr float CalculationHeight = 1;
 
@@ -135,6 +376,38 @@ protected:
     cooling m_cooling{ 250, 0.4, [](float t){ return t * 0.977; } };
     StaticLayout m_static_layout;
     bool m_relative_distance = true;
+    std::vector<stage_timing> m_stage_timings;
+    cancellation_token m_cancel;
+    Observer m_observer;
+    // buffers of tolerance, kept for the next call
+    typename StaticLayout::workspace m_workspace;
+
+    // returns a copy of this object, used by async
+    virtual std::shared_ptr<foresighted_layout> clone() const {
+        return std::make_shared<foresighted_layout>(*this);
+    }
+
+    // names the variant of the algorithm, their results differ, so it is part of hash_parameters
+    virtual const char* kind() const { return "serial"; }
+
+    // returns the pool to run stages on, null to run them sequentially
+    virtual detail::parallel* stage_pool() { return nullptr; }
+
+    // uses the pool for the static layout if StaticLayout accepts one
+    template<typename Graph>
+    auto static_layout_pass(Graph& graph, float width, float height, detail::parallel* pool, int)
+            -> decltype(m_static_layout(graph, width, height, *pool), void()) {
+        if (pool == nullptr) {
+            m_static_layout(graph, width, height);
+        } else {
+            m_static_layout(graph, width, height, *pool);
+        }
+    }
+
+    template<typename Graph>
+    void static_layout_pass(Graph& graph, float width, float height, detail::parallel*, long) {
+        m_static_layout(graph, width, height);
+    }
 
     // increases layout quality within tolerance
     virtual void tolerance(
@@ -149,32 +422,32 @@ protected:
         if (!m_relative_distance) {
             tolerance_value *= m_static_layout.relative_unit(width, height) * max_nodes(states);
         }
+        // an iteration only moves nodes, so the copies are made once
+        // and only positions are copied in the rounds, which doesn't allocate
+        std::vector<graph_state> copies = states;
         for (unsigned i = 0; i < m_cooling.iterations; ++i) {
+            m_cancel.check();
+            detail::scoped_phase<Observer> round(m_observer, layout_phase::tolerance_round);
             for (unsigned s = 0; s < states.size(); ++s) {
-                graph_state copy = states[s];
-                m_static_layout.iteration(copy, width, height, temp);
+                detail::scoped_phase<Observer> span(m_observer, layout_phase::state_iteration, s);
+                auto& copy = copies[s];
+                copy_positions(states[s], copy);
+                m_static_layout.iteration(copy, width, height, temp, m_workspace);
                 if ((s == 0 || distance(copy, states[s - 1]) < tolerance_value)
                         && (s >= states.size() - 1
                             || distance(copy, states[s + 1]) < tolerance_value)) {
-                    states[s] = std::move(copy);
+                    copy_positions(copy, states[s]);
+                    m_observer.count(layout_counter::accepted, 1);
+                } else {
+                    m_observer.count(layout_counter::rejected, 1);
                 }
             }
             temp = m_cooling.anneal(temp);
         }
     }
 
-    void basic_layout(std::vector<graph_state>& states, float width, float height) {
-        node_live_sets nodes_live = node_live_times(states);
-        edge_live_sets edges_live = edge_live_times(states);
-
-        // main steps
-        auto supergraph = calculate_supergraph(states);
-        auto gap = calculate_gap(std::move(supergraph), nodes_live, edges_live);
-        auto rgap = calculate_rgap(std::move(gap));
-
-        m_static_layout(rgap.graph(), width, height);
-
-        // use results
+    // sets positions of nodes in all states to the positions of their partitions
+    void use_positions(std::vector<graph_state>& states, const detail::mapped_graph& rgap) const {
         for (auto& state : states) {
             for (auto& node : state.nodes()) {
                 const auto& target_node = rgap.node_at(node.id());
@@ -315,6 +588,52 @@ protected:
         return rgap;
     }
 
+    // decides which of the improved copies are within tolerance, has to be sequential
+    void accept(
+            const std::vector<graph_state>& states
+            , const std::vector<graph_state>& copies
+            , std::vector<bool>& apply
+            , float tolerance_value) {
+        detail::scoped_phase<Observer> scope(m_observer, layout_phase::accept);
+        auto get = [&](unsigned i) -> const graph_state& {
+            if (apply[i]) {
+                return copies[i];
+            }
+            return states[i];
+        };
+        for (unsigned i = 0; i < states.size(); ++i) {
+            apply[i] = false;
+            if ((i == 0 || distance(copies[i], get(i - 1)) < tolerance_value)
+                    && (i >= states.size() - 1
+                        || distance(copies[i], states[i + 1]) < tolerance_value)) {
+                apply[i] = true;
+            }
+        }
+        if (Observer::enabled) {
+            unsigned accepted = std::count(apply.begin(), apply.end(), true);
+            m_observer.count(layout_counter::accepted, accepted);
+            m_observer.count(layout_counter::rejected, apply.size() - accepted);
+        }
+    }
+
+    // reports a copy of a graph state to the observer
+    void count_copy(const graph_state& state) {
+        if (Observer::enabled) {
+            m_observer.count(layout_counter::bytes_copied, state.nodes().size() * sizeof(node)
+                    + state.edges().size() * sizeof(edge));
+        }
+    }
+
+    // copies positions of nodes between two states with the same nodes in the same order
+    void copy_positions(const graph_state& from, graph_state& to) {
+        for (unsigned n = 0; n < from.nodes().size(); ++n) {
+            to.nodes()[n].pos() = from.nodes()[n].pos();
+        }
+        if (Observer::enabled) {
+            m_observer.count(layout_counter::bytes_copied, from.nodes().size() * sizeof(coords));
+        }
+    }
+
     unsigned max_nodes(std::vector<graph_state>& states) const {
         const auto& max = *std::max_element(states.begin(), states.end(),
                 [](const graph_state& a, const graph_state& b) {
@@ -325,21 +644,7 @@ protected:
 
     // calculates euclidean mental distance between two layouts
     float distance(const graph_state& one, const graph_state& two) const {
-        float result = 0;
-        unsigned count = 0;
-        for (const auto& node : one.nodes()) {
-            if (two.node_exists(node.id())) {
-                const auto& other = two.node_at(node.id());
-                float diff_x = node.pos().x - other.pos().x;
-                float diff_y = node.pos().y - other.pos().y;
-                result += std::sqrt(diff_x * diff_x + diff_y * diff_y);
-                ++count;
-            }
-        }
-        if (m_relative_distance) {
-            return result / static_cast<float>(count);
-        }
-        return result;
+        return mental_distance(one, two, m_relative_distance);
     }
 };
 
@@ -17,11 +17,51 @@
 
 #include "foresighted_layout.h"
 #include "parallel.h"
+#include "executor.h"
 
-#include <memory>
+#include <vector>
+#include <memory> // std::unique_ptr
+#include <mutex>
+#include <stdexcept> // std::logic_error
+#include <utility> // std::move
 
 namespace dyng {
 
+namespace detail {
+
+/// Objects reused by tasks, there are as many as tasks using them at the same time.
+/**
+ * Only allocates while more tasks than ever before use it at once.
+ */
+template<typename T>
+class object_pool {
+public:
+    /// Takes a free object or creates a new one.
+    std::unique_ptr<T> acquire() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_free.empty()) {
+                auto result = std::move(m_free.back());
+                m_free.pop_back();
+                return result;
+            }
+        }
+        return std::make_unique<T>();
+    }
+
+    /// Returns an object taken by acquire.
+    void release(std::unique_ptr<T> object) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(std::move(object));
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<T>> m_free;
+};
+
+} // namespace detail
+
 /**
  * A parallel implementation of the Foresighted Layout with Tolerance algorithm.
  * More specifically, it only uses parallel execution in the most performance demanding
@@ -34,8 +74,8 @@ namespace dyng {
  * 
  * @sa foresighted_layout
  */
-template<typename StaticLayout>
-class parallel_foresighted_layout : public foresighted_layout<StaticLayout> {
+template<typename StaticLayout, typename Observer = no_observer>
+class parallel_foresighted_layout : public foresighted_layout<StaticLayout, Observer> {
 public:
     parallel_foresighted_layout(
             unsigned threads
@@ -43,8 +83,23 @@ public:
             , float canvas_width
             , float canvas_height
             , coords center = coords())
-            : foresighted_layout<StaticLayout>(tolerance, canvas_width, canvas_height, center)
-            , m_parallel(std::make_unique<detail::parallel>(threads)) {}
+            : parallel_foresighted_layout(executor(threads), tolerance,
+                    canvas_width, canvas_height, center) {}
+
+    /// Initializes this to run on a given executor, which can be shared with other layouts.
+    /**
+     * For example, to use the process-wide pool:
+     *
+     *     dyng::default_layout_parallel layout(dyng::executor::shared(), 0.04, 1024, 640);
+     */
+    parallel_foresighted_layout(
+            executor exec
+            , float tolerance
+            , float canvas_width
+            , float canvas_height
+            , coords center = coords())
+            : foresighted_layout<StaticLayout, Observer>(tolerance, canvas_width, canvas_height, center)
+            , m_executor(std::move(exec)) {}
 
     /// Initializes this with a given number of threads and given tolerance.
     parallel_foresighted_layout(unsigned threads, float tolerance)
@@ -55,13 +110,70 @@ public:
             : parallel_foresighted_layout(4, 0) {}
 
     /// Sets the thread count.
+    /**
+     * This creates a new pool used only by this object.
+     *
+     * @throw std::logic_error If this runs on the shared executor, which
+     * would be silently left; use set_executor to change the executor instead.
+     */
     void set_threads(unsigned count) {
-        m_parallel = std::make_unique<detail::parallel>(count);
+        check_private_executor();
+        m_executor = executor(count, m_wait_policy);
+    }
+
+    /// Sets whether idle threads spin for a while before going to sleep.
+    /**
+     * Spinning (the default) makes each cooling round of tolerance start and end
+     * faster, which matters for small graphs; blocking saves CPU time.
+     * This creates a new pool used only by this object.
+     *
+     * @throw std::logic_error If this runs on the shared executor, see set_threads.
+     */
+    void set_wait_policy(detail::wait_policy policy) {
+        check_private_executor();
+        m_wait_policy = policy;
+        m_executor = executor(m_executor.threads(), policy);
     }
 
+    /// Sets whether every state is always processed by the same thread.
+    /**
+     * By default the states are split between threads dynamically in every
+     * cooling round. With locality, states are assigned to threads once and
+     * every thread creates its own copies of its states and its own workspace,
+     * so the memory is allocated close to the thread (on Linux the first touch
+     * decides the NUMA node) and stays in its caches across rounds.
+     * This works best together with executor::pin_threads. Avoid it on an executor
+     * that also runs long jobs (like executor::shared with async layouts), every round
+     * then waits for the jobs running on the workers (see detail::parallel::for_each_pinned).
+     *
+     * The results are the same either way.
+     */
+    void use_locality(bool value) { m_locality = value; }
+
+    /// Sets the executor to run on.
+    void set_executor(executor exec) { m_executor = std::move(exec); }
+
+    /// Returns the executor this runs on.
+    executor get_executor() const override { return m_executor; }
+
 private:
-    // is a unique ptr because class parallel is neither copyable nor movable
-    std::unique_ptr<detail::parallel> m_parallel;
+    detail::wait_policy m_wait_policy = detail::wait_policy::spin;
+    executor m_executor;
+    bool m_locality = false;
+
+    detail::parallel* stage_pool() override { return &m_executor.pool(); }
+
+    void check_private_executor() const {
+        if (m_executor.is_shared()) {
+            throw std::logic_error("the layout runs on the shared executor, use set_executor instead");
+        }
+    }
+
+    std::shared_ptr<foresighted_layout<StaticLayout, Observer>> clone() const override {
+        return std::make_shared<parallel_foresighted_layout>(*this);
+    }
+
+    const char* kind() const override { return "parallel"; }
 
     void tolerance(
             std::vector<graph_state>& states
@@ -73,48 +185,77 @@ private:
             tolerance_value *= this->m_static_layout.relative_unit(width, height)
                     * this->max_nodes(states);
         }
-        detail::barrier bar(m_parallel->count());
+        if (m_locality) {
+            local_tolerance(states, width, height, tolerance_value);
+            return;
+        }
+        // the copies are made once, the rounds only copy positions
         std::vector<graph_state> copies = states;
         std::vector<bool> apply(states.size());
-        auto get = [&](unsigned i) -> const graph_state& {
-            if (apply[i]) {
-                return copies[i];
-            }
-            return states[i];
-        };
-        // there is no benefit in iterating sequentially, so we can split the
-        // indices not in chunks but in an interleaved way;
-        // this makes it faster for incrementally growing dynamic graphs
-        // because the tasks are split more evenly
-        m_parallel->for_each_interleaved([&](unsigned begin, unsigned step){
-            for (unsigned r = 0; r < this->m_cooling.iterations; ++r) {
-                for (unsigned i = begin; i < states.size(); i += step) {
+        detail::object_pool<typename StaticLayout::workspace> workspaces;
+        for (unsigned r = 0; r < this->m_cooling.iterations; ++r) {
+            this->m_cancel.check();
+            detail::scoped_phase<Observer> round(this->m_observer, layout_phase::tolerance_round);
+            // states differ in size, so the range is split dynamically
+            // and idle threads steal the remaining work
+            m_executor.pool().parallel_for(0, states.size(), [&](unsigned begin, unsigned end){
+                auto ws = workspaces.acquire();
+                for (unsigned i = begin; i < end; ++i) {
+                    detail::scoped_phase<Observer> span(this->m_observer,
+                            layout_phase::state_iteration, i);
                     if (apply[i]) {
-                        states[i] = copies[i];
+                        this->copy_positions(copies[i], states[i]);
                     } else {
-                        copies[i] = states[i];
+                        this->copy_positions(states[i], copies[i]);
                     }
+                    this->m_static_layout.iteration(copies[i], width, height, temp, *ws);
                 }
-                for (unsigned i = begin; i < states.size(); i += step) {
-                    this->m_static_layout.iteration(copies[i], width, height, temp);
-                }
-                bar.wait();
-                if (begin == 0) {
-                    // only the first thread will do this
-                    // this has to be sequential
-                    for (unsigned i = 0; i < states.size(); ++i) {
-                        apply[i] = false;
-                        if ((i == 0 || this->distance(copies[i], get(i - 1)) < tolerance_value)
-                                && (i >= states.size() - 1
-                                    || this->distance(copies[i], states[i + 1]) < tolerance_value)) {
-                            apply[i] = true;
-                        }
+                workspaces.release(std::move(ws));
+            });
+            this->accept(states, copies, apply, tolerance_value);
+            temp = this->m_cooling.anneal(temp);
+        }
+    }
+
+    // same as tolerance, but every state stays with one thread
+    void local_tolerance(
+            std::vector<graph_state>& states
+            , float width
+            , float height
+            , float tolerance_value) {
+        float temp = this->m_cooling.start_temperature;
+        auto& pool = m_executor.pool();
+        unsigned threads = pool.count();
+        // copies are created by the threads that use them
+        std::vector<graph_state> copies(states.size());
+        std::vector<bool> apply(states.size());
+        std::vector<typename StaticLayout::workspace> workspaces(threads);
+        for (unsigned r = 0; r < this->m_cooling.iterations; ++r) {
+            this->m_cancel.check();
+            detail::scoped_phase<Observer> round(this->m_observer, layout_phase::tolerance_round);
+            // interleaved, so that growing graphs are split evenly
+            pool.for_each_pinned([&](unsigned thread){
+                for (unsigned i = thread; i < states.size(); i += threads) {
+                    detail::scoped_phase<Observer> span(this->m_observer,
+                            layout_phase::state_iteration, i);
+                    if (r == 0) {
+                        // move the state to memory allocated by this thread
+                        graph_state local = states[i];
+                        states[i] = std::move(local);
+                        copies[i] = states[i];
+                        this->count_copy(copies[i]);
+                    } else if (apply[i]) {
+                        this->copy_positions(copies[i], states[i]);
+                    } else {
+                        this->copy_positions(states[i], copies[i]);
                     }
-                    temp = this->m_cooling.anneal(temp);
+                    this->m_static_layout.iteration(copies[i], width, height, temp,
+                            workspaces[thread]);
                 }
-                bar.wait();
-            }
-        });
+            });
+            this->accept(states, copies, apply, tolerance_value);
+            temp = this->m_cooling.anneal(temp);
+        }
     }
 };
 
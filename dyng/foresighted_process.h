@@ -0,0 +1,411 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains an implementation of the Foresighted Layout with Tolerance
+ * algorithm that runs tolerance in multiple processes on one machine.
+ *
+ * @sa process_foresighted_layout
+ */
+#pragma once
+
+#include "foresighted_layout.h"
+#include "parallel.h" // detail::cpu_pause
+
+#include <vector>
+#include <atomic>
+#include <thread> // std::this_thread::yield
+#include <new> // placement new
+#include <cstddef>
+#include <stdexcept>
+#include <algorithm> // std::min
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DYNG_HAS_FORK
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#endif
+
+namespace dyng {
+
+namespace detail {
+
+#ifdef DYNG_HAS_FORK
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_BOOL_LOCK_FREE == 2,
+        "atomics in shared memory have to be lock-free");
+
+/// A barrier placed in memory shared between processes.
+/**
+ * Waiting processes spin for a while and then yield. A barrier can be broken,
+ * which releases all waiting processes with an exception;
+ * used when one of the processes fails.
+ */
+struct process_barrier {
+    std::atomic<unsigned> arrived{ 0 };
+    std::atomic<unsigned> generation{ 0 };
+    std::atomic<bool> broken{ false };
+    unsigned count;
+
+    explicit process_barrier(unsigned count)
+            : count(count) {}
+
+    /// @throw std::runtime_error If the barrier is broken.
+    void wait() {
+        unsigned current = generation;
+        if (++arrived == count) {
+            arrived = 0;
+            ++generation;
+            return;
+        }
+        for (unsigned spin = 0; generation == current; ++spin) {
+            if (broken) {
+                throw std::runtime_error("barrier broken by another process");
+            }
+            if (spin < 1024) {
+                cpu_pause();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+/// Anonymous memory shared with child processes created after it.
+class shared_segment {
+public:
+    explicit shared_segment(std::size_t size)
+            : m_size(size) {
+        m_data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (m_data == MAP_FAILED) {
+            throw std::runtime_error("cannot map shared memory");
+        }
+    }
+
+    shared_segment(const shared_segment&) = delete;
+    shared_segment& operator=(const shared_segment&) = delete;
+
+    ~shared_segment() { munmap(m_data, m_size); }
+
+    void* data() const { return m_data; }
+
+private:
+    std::size_t m_size;
+    void* m_data;
+};
+
+#endif
+
+} // namespace detail
+
+
+/**
+ * An implementation of the Foresighted Layout with Tolerance algorithm
+ * that runs tolerance in several worker processes.
+ *
+ * Every worker is forked from the calling process, so it starts with its own
+ * copy of the states and allocates from its own heap. Each worker improves
+ * a contiguous range of states; the positions of the improved copies are
+ * exchanged through shared memory and every worker then decides about
+ * all states, so only one barrier per cooling round is needed.
+ * The calling process only waits for the workers and collects the results.
+ *
+ * Produces the same results as @ref parallel_foresighted_layout for any
+ * number of processes. Without fork (on platforms other than POSIX),
+ * tolerance runs in the calling process.
+ *
+ * Workers are forked from a process that may have other threads, e.g. those
+ * of the shared @ref executor. POSIX only guarantees async-signal-safe
+ * functions in such a child, while the workers allocate memory; this relies
+ * on the C library making its allocator usable after fork, which glibc,
+ * musl and the macOS libc do. Any other lock held by another thread at the
+ * time of fork stays locked in the workers forever, so a custom StaticLayout
+ * must not use a pool or other threads in its iterations and the observers
+ * must not lock anything shared with other threads. The observer only
+ * receives events from the calling process; the workers report to their
+ * own copies, which are lost.
+ *
+ * The calling process sleeps until a worker exits; a cancellation is
+ * noticed within @ref CancelCheckInterval milliseconds and breaks the workers
+ * at their next barrier. A worker that exits abnormally releases the others
+ * the same way. Workers are reaped even if SIGCHLD is ignored; their result
+ * is then taken from the pipe each of them holds.
+ *
+ * @sa parallel_foresighted_layout
+ */
+template<typename StaticLayout, typename Observer = no_observer>
+class process_foresighted_layout : public foresighted_layout<StaticLayout, Observer> {
+public:
+    /// Initializes this with the number of worker processes and given parameters.
+    /**
+     * @throw std::invalid_argument If @p processes is 0.
+     */
+    process_foresighted_layout(
+            unsigned processes
+            , float tolerance
+            , float canvas_width
+            , float canvas_height
+            , coords center = coords())
+            : foresighted_layout<StaticLayout, Observer>(tolerance, canvas_width, canvas_height, center) {
+        set_processes(processes);
+    }
+
+    /// Initializes this with the number of worker processes and given tolerance.
+    process_foresighted_layout(unsigned processes, float tolerance)
+            : process_foresighted_layout(processes, tolerance, 1, 1) {}
+
+    /// Sets the number of worker processes.
+    /**
+     * @throw std::invalid_argument If @p count is 0.
+     */
+    void set_processes(unsigned count) {
+        if (count == 0) {
+            throw std::invalid_argument("process count must be at least 1");
+        }
+        m_processes = count;
+    }
+
+    unsigned processes() const { return m_processes; }
+
+    /// How often a waiting calling process checks for cancellation, in milliseconds.
+    static constexpr int CancelCheckInterval = 50;
+
+private:
+    unsigned m_processes = 1;
+
+    std::shared_ptr<foresighted_layout<StaticLayout, Observer>> clone() const override {
+        return std::make_shared<process_foresighted_layout>(*this);
+    }
+
+    const char* kind() const override { return "process"; }
+
+    void tolerance(
+            std::vector<graph_state>& states
+            , float width
+            , float height
+            , float tolerance_value) override {
+        if (!this->m_relative_distance) {
+            tolerance_value *= this->m_static_layout.relative_unit(width, height)
+                    * this->max_nodes(states);
+        }
+#ifdef DYNG_HAS_FORK
+        // offsets of the states in the arrays of positions
+        std::vector<std::size_t> offsets(states.size() + 1, 0);
+        for (unsigned i = 0; i < states.size(); ++i) {
+            offsets[i + 1] = offsets[i] + states[i].nodes().size();
+        }
+        std::size_t positions = offsets.back();
+        std::size_t header = (sizeof(detail::process_barrier) + alignof(coords) - 1)
+                / alignof(coords) * alignof(coords);
+        // two buffers for candidates, so that a round can start before others are read
+        detail::shared_segment segment(header + 3 * positions * sizeof(coords) + 1);
+        unsigned workers = std::min<unsigned>(m_processes, states.size());
+        auto* barrier = new (segment.data()) detail::process_barrier(workers);
+        auto* shared = reinterpret_cast<coords*>(static_cast<char*>(segment.data()) + header);
+        shared_positions buffers{ shared, shared + positions, shared + 2 * positions, &offsets };
+
+        std::vector<worker_process> children;
+        for (unsigned w = 0; w < workers; ++w) {
+            // the write end closes when the worker exits, for whatever reason
+            int fds[2];
+            pid_t pid = -1;
+            if (pipe(fds) == 0) {
+                fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+                fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+                pid = fork();
+                if (pid < 0) {
+                    close(fds[0]);
+                    close(fds[1]);
+                }
+            }
+            if (pid < 0) {
+                barrier->broken = true;
+                wait_for(children, *barrier);
+                throw std::runtime_error("cannot create a worker process");
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                for (const auto& c : children) {
+                    close(c.fd);
+                }
+                char status = 0;
+                try {
+                    unsigned chunk = (states.size() + workers - 1) / workers;
+                    unsigned begin = std::min<unsigned>(w * chunk, states.size());
+                    unsigned end = std::min<unsigned>(begin + chunk, states.size());
+                    worker(states, width, height, tolerance_value,
+                            begin, end, *barrier, buffers);
+                } catch (...) {
+                    barrier->broken = true;
+                    status = 1;
+                }
+                if (status == 0 && write(fds[1], &status, 1) != 1) {
+                    status = 1;
+                }
+                // the worker must not return to the caller or run exit handlers
+                _exit(status);
+            }
+            close(fds[1]);
+            children.push_back({ pid, fds[0] });
+        }
+        bool failed = wait_for(children, *barrier);
+        this->m_cancel.check();
+        if (failed) {
+            throw std::runtime_error("a worker process failed");
+        }
+        for (unsigned i = 0; i < states.size(); ++i) {
+            buffers.read(states[i], buffers.result, i);
+        }
+#else
+        foresighted_layout<StaticLayout, Observer>::tolerance(states, width, height, tolerance_value);
+#endif
+    }
+
+#ifdef DYNG_HAS_FORK
+    struct shared_positions {
+        coords* candidates[2];
+        coords* result;
+        const std::vector<std::size_t>* offsets;
+
+        void write(const graph_state& state, coords* buffer, unsigned index) const {
+            coords* out = buffer + (*offsets)[index];
+            for (const auto& n : state.nodes()) {
+                *out++ = n.pos();
+            }
+        }
+
+        void read(graph_state& state, const coords* buffer, unsigned index) const {
+            const coords* in = buffer + (*offsets)[index];
+            for (auto& n : state.nodes()) {
+                n.pos() = *in++;
+            }
+        }
+    };
+
+    // the same rounds as parallel_foresighted_layout, with states [begin, end) computed here
+    void worker(
+            std::vector<graph_state>& states
+            , float width
+            , float height
+            , float tolerance_value
+            , unsigned begin
+            , unsigned end
+            , detail::process_barrier& barrier
+            , const shared_positions& buffers) {
+        float temp = this->m_cooling.start_temperature;
+        std::vector<graph_state> copies = states;
+        std::vector<bool> apply(states.size());
+        for (unsigned r = 0; r < this->m_cooling.iterations; ++r) {
+            coords* candidates = buffers.candidates[r % 2];
+            for (unsigned i = begin; i < end; ++i) {
+                if (apply[i]) {
+                    this->copy_positions(copies[i], states[i]);
+                } else {
+                    this->copy_positions(states[i], copies[i]);
+                }
+                this->m_static_layout.iteration(copies[i], width, height, temp, this->m_workspace);
+                buffers.write(copies[i], candidates, i);
+            }
+            barrier.wait();
+            for (unsigned i = 0; i < states.size(); ++i) {
+                if (i >= begin && i < end) {
+                    continue;
+                }
+                // other states only need positions, the nodes are the same
+                if (apply[i]) {
+                    this->copy_positions(copies[i], states[i]);
+                }
+                buffers.read(copies[i], candidates, i);
+            }
+            this->accept(states, copies, apply, tolerance_value);
+            temp = this->m_cooling.anneal(temp);
+        }
+        for (unsigned i = begin; i < end; ++i) {
+            buffers.write(states[i], buffers.result, i);
+        }
+    }
+
+    struct worker_process {
+        pid_t pid;
+        int fd; // read end of the pipe, receives one byte on success
+    };
+
+    // waits for all workers, returns true if any of them failed
+    bool wait_for(std::vector<worker_process>& children, detail::process_barrier& barrier) {
+        bool failed = false;
+        std::vector<pollfd> fds;
+        while (!children.empty()) {
+            fds.clear();
+            for (const auto& c : children) {
+                fds.push_back({ c.fd, POLLIN, 0 });
+            }
+            int ready = poll(fds.data(), fds.size(), CancelCheckInterval);
+            if (ready < 0 && errno != EINTR) {
+                // cannot wait for any of them, only reaping is left
+                barrier.broken = true;
+                ready = 0;
+                for (auto& f : fds) {
+                    f.revents = POLLHUP;
+                }
+            }
+            if (this->m_cancel.cancelled()) {
+                barrier.broken = true;
+            }
+            for (unsigned i = fds.size(); i-- > 0;) {
+                if (fds[i].revents == 0) {
+                    continue;
+                }
+                if (!finish(children[i])) {
+                    // release the others, they would wait at the barrier forever
+                    failed = true;
+                    barrier.broken = true;
+                }
+                children.erase(children.begin() + i);
+            }
+        }
+        return failed;
+    }
+
+    // reaps a worker whose pipe is readable, returns true if it succeeded
+    static bool finish(const worker_process& child) {
+        char byte = 1;
+        ssize_t received;
+        do {
+            received = read(child.fd, &byte, 1);
+        } while (received < 0 && errno == EINTR);
+        close(child.fd);
+        bool success = received == 1 && byte == 0;
+        int status = 0;
+        pid_t done;
+        do {
+            done = waitpid(child.pid, &status, 0);
+        } while (done < 0 && errno == EINTR);
+        if (done < 0) {
+            // ECHILD: SIGCHLD is ignored and the worker was reaped automatically,
+            // so only the pipe tells how it ended
+            return success && errno == ECHILD;
+        }
+        return success && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+#endif
+};
+
+} // namespace dyng
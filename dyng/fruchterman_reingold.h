@@ -17,9 +17,13 @@
 
 #include "optimization_grid.h"
 #include "cooling.h"
+#include "parallel.h"
+#include "observer.h"
 
 #include <random>
 #include <cmath>
+#include <cstdint>
+#include <cstring> // std::memcpy
 #include <unordered_map>
 
 namespace dyng {
@@ -32,10 +36,12 @@ namespace dyng {
  * (Referenced in section 6.1.2)
  * 
  * @tparam InitialLayout Function object that crates initial placement.
+ * @tparam Observer Receives the static passes and counts of iterations
+ * and evaluated pairs of nodes, see @ref no_observer.
  * 
  * @sa cooling
  */
-template<typename InitialLayout>
+template<typename InitialLayout, typename Observer = no_observer>
 class fruchterman_reingold {
 
 using disp_map = std::unordered_map<node_id, coords>;
@@ -57,8 +63,25 @@ public:
             return;
         }
         m_initial_layouter(graph, canvas_width, canvas_height);
-        layout_pass(canvas_width, canvas_height, graph, m_first_cooling);
-        layout_pass(canvas_width, canvas_height, graph, m_second_cooling);
+        layout_pass(canvas_width, canvas_height, graph, m_first_cooling, nullptr);
+        layout_pass(canvas_width, canvas_height, graph, m_second_cooling, nullptr);
+    }
+
+    /// Same as above, iterations are computed in parallel on @p pool in deterministic mode.
+    /**
+     * Without deterministic mode the pool is not used, because splitting
+     * the work would change the order of floating-point operations.
+     *
+     * @sa use_deterministic
+     */
+    template<typename Graph>
+    void operator()(Graph& graph, float canvas_width, float canvas_height, detail::parallel& pool) {
+        if (graph.nodes().empty()) {
+            return;
+        }
+        m_initial_layouter(graph, canvas_width, canvas_height);
+        layout_pass(canvas_width, canvas_height, graph, m_first_cooling, &pool);
+        layout_pass(canvas_width, canvas_height, graph, m_second_cooling, &pool);
     }
 
     /// Returns the object that crates initial placement.
@@ -82,6 +105,9 @@ public:
         m_second_cooling = std::move(c);
     }
 
+    const cooling& first_cooling() const { return m_first_cooling; }
+    const cooling& second_cooling() const { return m_second_cooling; }
+
     /// Sets the coefficient for the parameter k representing average edge length.
     /**
      * Default value is 0.6.
@@ -113,6 +139,36 @@ public:
         m_use_global_repulsion = value;
     }
 
+    /// Switches the deterministic mode, which allows iterations to run in parallel.
+    /**
+     * In deterministic mode the forces acting on every node are summed by a single
+     * task in a fixed order (the nodes are split into chunks of a fixed size),
+     * and random displacement of nodes at the same position is derived from
+     * the node identifiers and the temperature instead of a shared generator.
+     * The results are then bit-identical for any number of threads,
+     * with or without a pool, but differ from the results of the default mode.
+     *
+     * Switched off by default.
+     */
+    void use_deterministic(bool value) {
+        m_deterministic = value;
+    }
+
+    /// Adds all parameters that affect the resulting layout to a hash.
+    /**
+     * @sa layout_cache
+     */
+    template<typename Hasher>
+    void hash_parameters(Hasher& hasher) const {
+        hasher.add(m_border_force);
+        hasher.add(m_k_coeff);
+        hasher.add(m_use_global_repulsion);
+        hasher.add(m_deterministic);
+        m_first_cooling.hash_parameters(hasher);
+        m_second_cooling.hash_parameters(hasher);
+        m_initial_layouter.hash_parameters(hasher);
+    }
+
     /**
      * Does a single iteration of the algorithm with a given temperature within
      * specified bounds ([-width/2, width/2] and [-height/2, height/2]).
@@ -126,29 +182,83 @@ public:
      */
     template<typename Graph>
     void iteration(Graph& graph, float width, float height, float temperature) {
+        workspace ws;
+        iteration(graph, width, height, temperature, ws);
+    }
+
+    /// Buffers used by an iteration, can be reused to avoid allocations.
+    /**
+     * A workspace must not be used by multiple threads at the same time.
+     */
+    struct workspace {
+        std::vector<coords> displacements;
+        // edges incident to every node, used in deterministic mode
+        std::vector<unsigned> adjacency_begin;
+        std::vector<unsigned> adjacency;
+        detail::optimization_grid grid;
+    };
+
+    /// Same as above, uses buffers from a workspace.
+    /**
+     * In deterministic mode the iteration runs in parallel if @p pool is not null.
+     */
+    template<typename Graph>
+    void iteration(Graph& graph
+            , float width
+            , float height
+            , float temperature
+            , workspace& ws
+            , detail::parallel* pool = nullptr) {
         float area = width * height;
         float k = m_k_coeff * std::sqrt(area / static_cast<float>(graph.nodes().size()));
+        float seed = temperature;
         temperature = temperature * relative_unit(width, height);
 
-        std::vector<coords> displacements(graph.nodes().size());
-        reset_and_border(graph, width, height, k, displacements);
-        repulsive_forces(graph, width, height, k, temperature, displacements);
-        attractive_forces(graph, k, displacements);
-        displacement(graph, width, height, temperature, displacements);
+        m_observer.count(layout_counter::iterations, 1);
+        if (m_deterministic) {
+            deterministic_iteration(graph, width, height, k, temperature, seed, ws, pool);
+        } else {
+            auto& displacements = ws.displacements;
+            // every element is overwritten by reset_and_border
+            displacements.resize(graph.nodes().size());
+            reset_and_border(graph, width, height, k, displacements);
+            repulsive_forces(graph, width, height, k, temperature, displacements, ws.grid);
+            attractive_forces(graph, k, displacements);
+            displacement(graph, width, height, temperature, displacements);
+        }
+        if (Observer::samples_iterations) {
+            // seed is the temperature in relative units
+            m_observer.sample(sample_of(graph, width, height, k, ws.displacements,
+                    seed, relative_unit(width, height)));
+        }
     }
 
+    /// Sets the observer of the computation.
+    void set_observer(Observer observer) { m_observer = std::move(observer); }
+
+    const Observer& observer() const { return m_observer; }
+    Observer& observer() { return m_observer; }
+
 private:
     static constexpr float SmallOffset = 0.001f;
     static constexpr float UnitCoeff = 0.68;
 
+    // the number of nodes processed by one task in deterministic mode
+    static constexpr unsigned ChunkSize = 64;
+
     float m_border_force = 0.6;
     float m_k_coeff = 0.6;
     bool m_use_global_repulsion = false; // use local repulsion limited to the radius of 2k
+    bool m_deterministic = false;
 
     cooling m_first_cooling{ 500, 0.8, [](float t){ return t * 0.9893; } };
     cooling m_second_cooling{ 500, 0.05, [](float t){ return t * 0.993; } };
 
     InitialLayout m_initial_layouter;
+    // kept between calls, so a reused object doesn't allocate its buffers again
+    workspace m_workspace;
+    // called from const methods, which can run concurrently
+    mutable Observer m_observer;
 
     template<typename Graph>
     void reset_and_border(
@@ -172,12 +282,17 @@ private:
             , float height
             , float k
             , float t
-            , std::vector<coords>& disp) const {
+            , std::vector<coords>& disp
+            , detail::optimization_grid& grid) const {
         std::mt19937 rand_gen(0); // to allow random displacement when necessary
         std::uniform_real_distribution<float> rand_angle(0.0f, 3.14159f * 2.0f);
 
         // calculate repulsive forces
-        for_each_pair_of_nodes(graph, width, height, k, [&](unsigned i, unsigned j){
+        std::uint64_t pairs = 0;
+        for_each_pair_of_nodes(graph, width, height, k, grid, [&](unsigned i, unsigned j){
+            if (Observer::enabled) {
+                ++pairs;
+            }
             auto& node_i = graph.nodes()[i];
             auto& node_j = graph.nodes()[j];
             float diff_x = node_j.pos().x - node_i.pos().x;
@@ -200,6 +315,7 @@ private:
                 disp[j].y += diff_y * rep_force;
             }
         });
+        m_observer.count(layout_counter::pairs, pairs);
     }
 
     // calls func exactly once for each pair of nodes
@@ -209,6 +325,7 @@ private:
             , float width
             , float height
             , float k
+            , detail::optimization_grid& grid
             , Function func) const {
         if (m_use_global_repulsion) {
             for (unsigned i = 0; i < graph.nodes().size(); ++i) {
@@ -218,14 +335,15 @@ private:
             }
         } else {
             // setup the grid
-            detail::optimization_grid m_grid(width, height, k);
+            grid.reset(width, height, k);
             for (unsigned i = 0; i < graph.nodes().size(); ++i) {
-                m_grid.add(graph.nodes()[i].pos(), i);
+                grid.add(graph.nodes()[i].pos(), i);
             }
+            grid.sort();
             // iterate through all pairs that are close together
             for (unsigned i = 0; i < graph.nodes().size(); ++i) {
                 auto& node_i = graph.nodes()[i];
-                m_grid.for_each_around(node_i.pos(), [&](unsigned j){
+                grid.for_each_around(node_i.pos(), [&](unsigned j){
                     if (j < i) {
                         func(i, j);
                     }
@@ -263,7 +381,19 @@ private:
             , float height
             , float t
             , const std::vector<coords>& disp) const {
-        for (unsigned i = 0; i < graph.nodes().size(); ++i) {
+        displacement(graph, width, height, t, disp, 0, graph.nodes().size());
+    }
+
+    template<typename Graph>
+    void displacement(
+            Graph& graph
+            , float width
+            , float height
+            , float t
+            , const std::vector<coords>& disp
+            , unsigned begin
+            , unsigned end) const {
+        for (unsigned i = begin; i < end; ++i) {
             auto& node = graph.nodes()[i];
             const auto& current_disp = disp[i];
             float disp_len = length(current_disp.x, current_disp.y);
@@ -294,14 +424,226 @@ private:
             float width
             , float height
             , Graph& graph
-            , const cooling& c) {
+            , const cooling& c
+            , detail::parallel* pool) {
+        detail::scoped_phase<Observer> scope(m_observer, layout_phase::static_pass);
         float t = c.start_temperature;
         for (unsigned r = 0; r < c.iterations; ++r) {
-            iteration(graph, width, height, t);
+            iteration(graph, width, height, t, m_workspace, pool);
             t = c.anneal(t);
         }
     }
 
+    // describes an iteration by the forces that acted in it and the energy of the new positions,
+    // lengths are divided by @p unit to make them relative
+    template<typename Graph>
+    iteration_sample sample_of(
+            const Graph& graph
+            , float width
+            , float height
+            , float k
+            , const std::vector<coords>& disp
+            , float temperature
+            , float unit) const {
+        iteration_sample result;
+        result.temperature = temperature;
+        result.nodes = disp.size();
+        for (const auto& d : disp) {
+            double moved = std::min<double>(length(d.x, d.y) / unit, temperature);
+            result.displacement += moved;
+            result.max_displacement = std::max(result.max_displacement, moved);
+        }
+        // the potential whose gradient are the forces: d^3 / 3k for edges,
+        // k^2 ln(2k / d) for pairs of nodes closer than 2k (or all pairs)
+        double energy = 0;
+        for (const auto& e : graph.edges()) {
+            const auto& one = graph.node_at(e.one_id()).pos();
+            const auto& two = graph.node_at(e.two_id()).pos();
+            double d = length(two.x - one.x, two.y - one.y);
+            energy += d * d * d / (3 * k);
+        }
+        unsigned size = graph.nodes().size();
+        auto repulsion = [&](unsigned i, unsigned j){
+            const auto& a = graph.nodes()[i].pos();
+            const auto& b = graph.nodes()[j].pos();
+            double d = std::max<double>(length(b.x - a.x, b.y - a.y), k * SmallOffset);
+            if (m_use_global_repulsion || d < k * 2.0) {
+                energy += k * k * std::log(2 * k / d);
+            }
+        };
+        if (m_use_global_repulsion) {
+            for (unsigned i = 0; i < size; ++i) {
+                for (unsigned j = i + 1; j < size; ++j) {
+                    repulsion(i, j);
+                }
+            }
+        } else {
+            detail::optimization_grid grid(width, height, k);
+            for (unsigned i = 0; i < size; ++i) {
+                grid.add(graph.nodes()[i].pos(), i);
+            }
+            grid.sort();
+            for (unsigned i = 0; i < size; ++i) {
+                grid.for_each_around(graph.nodes()[i].pos(), [&](unsigned j){
+                    if (j > i) {
+                        repulsion(i, j);
+                    }
+                });
+            }
+        }
+        result.energy = energy / (unit * unit);
+        return result;
+    }
+
+    // calls func(begin, end) for fixed chunks of nodes, in parallel if there is a pool
+    template<typename Function>
+    void for_each_chunk(unsigned size, detail::parallel* pool, const Function& func) const {
+        unsigned chunks = (size + ChunkSize - 1) / ChunkSize;
+        auto chunk = [&](unsigned first, unsigned last){
+            for (unsigned c = first; c < last; ++c) {
+                func(c * ChunkSize, std::min(size, (c + 1) * ChunkSize));
+            }
+        };
+        if (pool == nullptr || chunks <= 1) {
+            chunk(0, chunks);
+        } else {
+            pool->parallel_for(0, chunks, 1, chunk);
+        }
+    }
+
+    // a random angle that depends only on the two nodes and the temperature
+    float pair_angle(std::uint32_t one, std::uint32_t two, float seed) const {
+        std::uint32_t seed_bits;
+        std::memcpy(&seed_bits, &seed, sizeof(seed_bits));
+        std::uint64_t x = (static_cast<std::uint64_t>(std::min(one, two)) << 32 | std::max(one, two))
+                ^ (static_cast<std::uint64_t>(seed_bits) * 0x9e3779b97f4a7c15ull);
+        // splitmix64 finalizer
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        x = x ^ (x >> 31);
+        return static_cast<float>(x >> 40) / static_cast<float>(1 << 24) * 3.14159f * 2.0f;
+    }
+
+    // an iteration where every node's displacement is computed independently,
+    // from the same contributions in the same order as in any other split
+    template<typename Graph>
+    void deterministic_iteration(
+            Graph& graph
+            , float width
+            , float height
+            , float k
+            , float t
+            , float seed
+            , workspace& ws
+            , detail::parallel* pool) {
+        unsigned size = graph.nodes().size();
+        auto& disp = ws.displacements;
+        disp.resize(size);
+        build_adjacency(graph, ws);
+
+        auto& grid = ws.grid;
+        if (!m_use_global_repulsion) {
+            grid.reset(width, height, k);
+            for (unsigned i = 0; i < size; ++i) {
+                grid.add(graph.nodes()[i].pos(), i);
+            }
+            grid.sort();
+        }
+        for_each_chunk(size, pool, [&](unsigned begin, unsigned end){
+            // every pair is evaluated from both sides
+            std::uint64_t pairs = 0;
+            for (unsigned i = begin; i < end; ++i) {
+                const auto& node_i = graph.nodes()[i];
+                coords d;
+                d.x = border_displacement(k, width, node_i.pos().x);
+                d.y = border_displacement(k, height, node_i.pos().y);
+                auto repulse = [&](unsigned j){
+                    if (j == i) {
+                        return;
+                    }
+                    if (Observer::enabled) {
+                        ++pairs;
+                    }
+                    // the pair (i, j) has the same effect as in repulsive_forces
+                    // with the roles decided by the indices
+                    float sign = j < i ? -1.0f : 1.0f;
+                    const auto& node_j = graph.nodes()[j];
+                    float diff_x = (node_j.pos().x - node_i.pos().x) * -sign;
+                    float diff_y = (node_j.pos().y - node_i.pos().y) * -sign;
+                    float dst = length(diff_x, diff_y);
+                    if (dst == 0) {
+                        float angle = pair_angle(node_i.id().value, node_j.id().value, seed);
+                        float r = t * 0.5;
+                        d.x += sign * std::cos(angle) * r;
+                        d.y += sign * std::sin(angle) * r;
+                    } else if (m_use_global_repulsion || dst < k * 2.0f) {
+                        float rep_force = (1.0f / dst) * (k * k / dst);
+                        d.x += sign * diff_x * rep_force;
+                        d.y += sign * diff_y * rep_force;
+                    }
+                };
+                if (m_use_global_repulsion) {
+                    for (unsigned j = 0; j < size; ++j) {
+                        repulse(j);
+                    }
+                } else {
+                    grid.for_each_around(node_i.pos(), repulse);
+                }
+                for (unsigned a = ws.adjacency_begin[i]; a < ws.adjacency_begin[i + 1]; ++a) {
+                    const auto& e = graph.edges()[ws.adjacency[a]];
+                    unsigned index_one = graph.node_index(e.one_id());
+                    unsigned index_two = graph.node_index(e.two_id());
+                    const auto& one = graph.nodes()[index_one].pos();
+                    const auto& two = graph.nodes()[index_two].pos();
+                    float diff_x = two.x - one.x;
+                    float diff_y = two.y - one.y;
+                    float dst = length(diff_x, diff_y);
+                    if (dst != 0.0f) {
+                        float attr_force = (1.0f / dst) * (dst * dst / k);
+                        float sign = index_one == i ? 1.0f : -1.0f;
+                        d.x += sign * diff_x * attr_force;
+                        d.y += sign * diff_y * attr_force;
+                    }
+                }
+                disp[i] = d;
+            }
+            m_observer.count(layout_counter::pairs, pairs);
+        });
+        for_each_chunk(size, pool, [&](unsigned begin, unsigned end){
+            displacement(graph, width, height, t, disp, begin, end);
+        });
+    }
+
+    // lists the edges of every node in the order of graph.edges()
+    template<typename Graph>
+    void build_adjacency(const Graph& graph, workspace& ws) const {
+        unsigned size = graph.nodes().size();
+        ws.adjacency_begin.assign(size + 2, 0);
+        for (const auto& e : graph.edges()) {
+            unsigned one = graph.node_index(e.one_id());
+            unsigned two = graph.node_index(e.two_id());
+            ++ws.adjacency_begin[one + 2];
+            if (two != one) {
+                ++ws.adjacency_begin[two + 2];
+            }
+        }
+        for (unsigned i = 2; i < size + 2; ++i) {
+            ws.adjacency_begin[i] += ws.adjacency_begin[i - 1];
+        }
+        ws.adjacency.resize(ws.adjacency_begin[size + 1]);
+        // adjacency_begin[i + 1] is used as the insertion point of node i
+        for (unsigned index = 0; index < graph.edges().size(); ++index) {
+            const auto& e = graph.edges()[index];
+            unsigned one = graph.node_index(e.one_id());
+            unsigned two = graph.node_index(e.two_id());
+            ws.adjacency[ws.adjacency_begin[one + 1]++] = index;
+            if (two != one) {
+                ws.adjacency[ws.adjacency_begin[two + 1]++] = index;
+            }
+        }
+        ws.adjacency_begin.pop_back();
+    }
+
     float pow2(float one) const {
         return one * one;
     }
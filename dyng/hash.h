@@ -0,0 +1,59 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstddef> // std::size_t
+#include <cstring> // std::memcpy
+#include <type_traits> // std::enable_if, std::is_arithmetic
+
+namespace dyng {
+
+namespace detail {
+
+/// Incremental 64-bit FNV-1a hash.
+/**
+ * Used for checksums of stored data. Values are hashed by their
+ * byte representation, so the result is only stable on the same platform.
+ */
+class fnv_hash {
+public:
+    void add(const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            m_value ^= bytes[i];
+            m_value *= Prime;
+        }
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type add(T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        add(bytes, sizeof(T));
+    }
+
+    std::uint64_t value() const { return m_value; }
+
+private:
+    static constexpr std::uint64_t Prime = 1099511628211ull;
+
+    std::uint64_t m_value = 14695981039346656037ull;
+};
+
+} // namespace detail
+
+} // namespace dyng
@@ -0,0 +1,690 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains streaming importers of dynamic graphs from
+ * commonly used formats: timestamped edge lists and GraphML.
+ *
+ * Both importers read the input sequentially and translate it directly to
+ * modifications of a @ref dynamic_graph, so apart from the resulting dynamic
+ * graph they only keep a map of node names and currently existing edges.
+ *
+ * @sa edge_list_reader,
+ * graphml_reader
+ */
+#pragma once
+
+#include "dynamic_graph.h"
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cmath> // std::floor
+#include <algorithm> // std::min, std::max
+#include <cctype> // std::isspace
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility> // std::move
+
+namespace dyng {
+
+namespace detail {
+
+/// Converts a timestamp to the index of a state.
+/**
+ * Used by the importers. Timestamps are counted from @p origin and
+ * every @p step of time forms one state.
+ */
+inline unsigned time_to_state(double time, double origin, double step) {
+    double state = std::floor((time - origin) / step);
+    if (!(state >= 0) || state > std::numeric_limits<unsigned>::max() - 1.0) {
+        throw std::runtime_error("time out of range");
+    }
+    return static_cast<unsigned>(state);
+}
+
+inline std::uint64_t edge_key(node_id one, node_id two) {
+    if (two < one) {
+        std::swap(one, two);
+    }
+    return (static_cast<std::uint64_t>(one.value) << 32) | two.value;
+}
+
+/// A minimal pull-style (SAX-like) XML tokenizer.
+/**
+ * Reads one element tag or text block at a time from a stream without building
+ * any tree. Handles comments, processing instructions, declarations, CDATA
+ * sections and the predefined and numeric character entities.
+ * Namespace prefixes are removed from element and attribute names.
+ *
+ * Used internally by @ref graphml_reader.
+ */
+class xml_reader {
+public:
+    enum class event { start, end, text, eof };
+
+    explicit xml_reader(std::istream& in)
+            : m_in(in) {}
+
+    /// Reads the next event.
+    /**
+     * An empty element tag (<a/>) produces a start event followed by an end event.
+     *
+     * @throw std::runtime_error If the input is not well-formed.
+     */
+    event next() {
+        if (m_pending_end) {
+            m_pending_end = false;
+            return event::end;
+        }
+        m_name.clear();
+        m_text.clear();
+        m_attributes.clear();
+        while (true) {
+            int ch = m_in.get();
+            if (ch == std::char_traits<char>::eof()) {
+                return event::eof;
+            }
+            if (ch != '<') {
+                m_text += static_cast<char>(ch);
+                read_text();
+                return event::text;
+            }
+            ch = m_in.peek();
+            if (ch == '?') {
+                skip_past("?>");
+            } else if (ch == '!') {
+                m_in.get();
+                if (m_in.peek() == '-') {
+                    skip_past("-->");
+                } else if (m_in.peek() == '[') {
+                    skip_past("[CDATA[");
+                    read_cdata();
+                    return event::text;
+                } else {
+                    skip_declaration();
+                }
+            } else if (ch == '/') {
+                m_in.get();
+                m_name = local(read_name());
+                skip_space();
+                expect('>');
+                return event::end;
+            } else {
+                read_tag();
+                return event::start;
+            }
+        }
+    }
+
+    /// Returns the name of the current element.
+    const std::string& name() const { return m_name; }
+
+    /// Returns the text of the current text event.
+    const std::string& text() const { return m_text; }
+
+    /// Returns the value of an attribute of the current element or nullptr.
+    const std::string* attribute(const std::string& name) const {
+        for (const auto& attr : m_attributes) {
+            if (attr.first == name) {
+                return &attr.second;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    std::istream& m_in;
+    std::string m_name;
+    std::string m_text;
+    std::vector<std::pair<std::string, std::string>> m_attributes;
+    bool m_pending_end = false;
+
+    static std::string local(std::string name) {
+        auto colon = name.find(':');
+        if (colon != std::string::npos && name.compare(0, colon, "xmlns") != 0) {
+            name.erase(0, colon + 1);
+        }
+        return name;
+    }
+
+    static bool is_name_char(int ch) {
+        return ch != std::char_traits<char>::eof() && !std::isspace(ch)
+                && ch != '>' && ch != '/' && ch != '=' && ch != '<';
+    }
+
+    int get() {
+        int ch = m_in.get();
+        if (ch == std::char_traits<char>::eof()) {
+            throw std::runtime_error("unexpected end of XML input");
+        }
+        return ch;
+    }
+
+    void expect(char expected) {
+        using namespace std::string_literals;
+        if (get() != expected) {
+            throw std::runtime_error("malformed XML, expected '"s + expected + "'"s);
+        }
+    }
+
+    void skip_space() {
+        while (std::isspace(m_in.peek())) {
+            m_in.get();
+        }
+    }
+
+    void skip_past(const std::string& end) {
+        std::string window;
+        while (window.size() < end.size() || window.compare(window.size() - end.size(),
+                end.size(), end) != 0) {
+            window += static_cast<char>(get());
+            if (window.size() > end.size()) {
+                window.erase(window.begin());
+            }
+        }
+    }
+
+    void skip_declaration() {
+        // <!DOCTYPE ...> possibly with an internal subset in brackets
+        int depth = 0;
+        while (true) {
+            int ch = get();
+            if (ch == '[') {
+                ++depth;
+            } else if (ch == ']') {
+                --depth;
+            } else if (ch == '>' && depth <= 0) {
+                return;
+            }
+        }
+    }
+
+    std::string read_name() {
+        std::string result;
+        while (is_name_char(m_in.peek())) {
+            result += static_cast<char>(m_in.get());
+        }
+        if (result.empty()) {
+            throw std::runtime_error("malformed XML, expected a name");
+        }
+        return result;
+    }
+
+    void read_entity(std::string& out) {
+        std::string entity;
+        int ch;
+        while ((ch = get()) != ';') {
+            entity += static_cast<char>(ch);
+            if (entity.size() > 10) {
+                throw std::runtime_error("malformed XML entity");
+            }
+        }
+        if (entity == "lt") {
+            out += '<';
+        } else if (entity == "gt") {
+            out += '>';
+        } else if (entity == "amp") {
+            out += '&';
+        } else if (entity == "quot") {
+            out += '"';
+        } else if (entity == "apos") {
+            out += '\'';
+        } else if (entity.size() > 1 && entity[0] == '#') {
+            bool hex = entity[1] == 'x';
+            unsigned long code = std::stoul(entity.substr(hex ? 2 : 1), nullptr, hex ? 16 : 10);
+            append_utf8(out, code);
+        } else {
+            throw std::runtime_error("unknown XML entity '" + entity + "'");
+        }
+    }
+
+    static void append_utf8(std::string& out, unsigned long code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    void read_text() {
+        if (m_text.back() == '&') {
+            m_text.pop_back();
+            read_entity(m_text);
+        }
+        while (m_in.peek() != '<' && m_in.peek() != std::char_traits<char>::eof()) {
+            int ch = m_in.get();
+            if (ch == '&') {
+                read_entity(m_text);
+            } else {
+                m_text += static_cast<char>(ch);
+            }
+        }
+    }
+
+    void read_cdata() {
+        while (m_text.size() < 3 || m_text.compare(m_text.size() - 3, 3, "]]>") != 0) {
+            m_text += static_cast<char>(get());
+        }
+        m_text.erase(m_text.size() - 3);
+    }
+
+    void read_tag() {
+        m_name = local(read_name());
+        while (true) {
+            skip_space();
+            int ch = m_in.peek();
+            if (ch == '>') {
+                m_in.get();
+                return;
+            }
+            if (ch == '/') {
+                m_in.get();
+                expect('>');
+                m_pending_end = true;
+                return;
+            }
+            std::string attr = local(read_name());
+            skip_space();
+            expect('=');
+            skip_space();
+            int quote = get();
+            if (quote != '"' && quote != '\'') {
+                throw std::runtime_error("malformed XML, expected a quoted attribute value");
+            }
+            std::string value;
+            while ((ch = get()) != quote) {
+                if (ch == '&') {
+                    read_entity(value);
+                } else {
+                    value += static_cast<char>(ch);
+                }
+            }
+            m_attributes.emplace_back(std::move(attr), std::move(value));
+        }
+    }
+};
+
+} // namespace detail
+
+
+/// Imports a dynamic graph from a list of timestamped edges.
+/**
+ * Every line of the input describes one event:
+ *
+ *     source target time [+|-]
+ *
+ * The fields are separated by a delimiter (any whitespace by default).
+ * Nodes are identified by arbitrary names and are created when they are
+ * mentioned for the first time. The optional last field tells whether the edge
+ * is added ('+', the default) or removed ('-'). Adding an edge that already
+ * exists is ignored, removing one that does not exist is an error unless
+ * an edge lifetime is set. Empty lines and lines starting with '#' are skipped.
+ *
+ * The events have to be sorted by time. Time is converted to states using
+ * a time step: every step of time since the first event forms one state.
+ * When an edge lifetime is set, edges are removed automatically when they
+ * have not been seen for that many states.
+ *
+ * The input is processed line by line, it is never stored as a whole.
+ *
+ * @sa graphml_reader
+ */
+class edge_list_reader {
+public:
+    edge_list_reader() = default;
+
+    /// Sets the delimiter of fields. Space means any sequence of whitespace.
+    explicit edge_list_reader(char delimiter)
+            : m_delimiter(delimiter) {}
+
+    /// Sets the delimiter of fields. Space means any sequence of whitespace.
+    void set_delimiter(char delimiter) { m_delimiter = delimiter; }
+
+    /// Sets how much time one state represents. Default value is 1.
+    /**
+     * @throw std::invalid_argument If @p step <= 0.
+     */
+    void set_time_step(double step) {
+        if (!(step > 0)) {
+            throw std::invalid_argument("time step has to be positive");
+        }
+        m_time_step = step;
+    }
+
+    /// Sets the number of states after which an edge that is not seen again is removed.
+    /**
+     * Default value is 0 which means edges are only removed explicitly.
+     */
+    void set_edge_lifetime(unsigned states) { m_lifetime = states; }
+
+    /// Adds the modifications described by @p in to @p dgraph and builds it.
+    /**
+     * @throw std::runtime_error If the input is malformed, with the number of the line.
+     * @throw invalid_graph If the resulting dynamic graph is invalid.
+     */
+    void operator()(std::istream& in, dynamic_graph& dgraph) const {
+        struct edge_entry {
+            edge_id id;
+            unsigned last_seen;
+        };
+        std::unordered_map<std::string, node_id> nodes;
+        std::unordered_map<std::uint64_t, edge_entry> edges;
+        // edges in the order they might expire (an entry is stale if the edge was seen again)
+        std::deque<std::pair<unsigned, std::uint64_t>> expiring;
+
+        bool first = true;
+        double origin = 0;
+        double last_time = 0;
+        std::string line;
+        std::vector<std::string> fields;
+        for (unsigned number = 1; std::getline(in, line); ++number) {
+            try {
+                split(line, fields);
+                if (fields.empty() || fields[0][0] == '#') {
+                    continue;
+                }
+                if (fields.size() != 3 && fields.size() != 4) {
+                    throw std::runtime_error("expected 3 or 4 fields");
+                }
+                double time = std::stod(fields[2]);
+                if (first) {
+                    origin = time;
+                    first = false;
+                } else if (time < last_time) {
+                    throw std::runtime_error("events are not sorted by time");
+                }
+                last_time = time;
+                unsigned state = detail::time_to_state(time, origin, m_time_step);
+
+                while (!expiring.empty() && expiring.front().first <= state) {
+                    auto found = edges.find(expiring.front().second);
+                    if (found != edges.end()
+                            && found->second.last_seen + m_lifetime == expiring.front().first) {
+                        dgraph.remove_edge(expiring.front().first, found->second.id);
+                        edges.erase(found);
+                    }
+                    expiring.pop_front();
+                }
+
+                auto get_node = [&](const std::string& name){
+                    auto found = nodes.find(name);
+                    if (found != nodes.end()) {
+                        return found->second;
+                    }
+                    node_id id = dgraph.add_node(state);
+                    nodes.emplace(name, id);
+                    return id;
+                };
+                node_id one = get_node(fields[0]);
+                node_id two = get_node(fields[1]);
+                std::uint64_t key = detail::edge_key(one, two);
+                auto found = edges.find(key);
+                if (fields.size() == 3 || fields[3] == "+") {
+                    if (found == edges.end()) {
+                        edge_id id = dgraph.add_edge(state, one, two);
+                        found = edges.emplace(key, edge_entry{ id, state }).first;
+                    }
+                    found->second.last_seen = state;
+                    if (m_lifetime != 0) {
+                        expiring.emplace_back(state + m_lifetime, key);
+                    }
+                } else if (fields[3] == "-") {
+                    if (found != edges.end()) {
+                        dgraph.remove_edge(state, found->second.id);
+                        edges.erase(found);
+                    } else if (m_lifetime == 0) {
+                        // (with a lifetime the edge could have expired already)
+                        throw std::runtime_error("removing an edge that does not exist");
+                    }
+                } else {
+                    throw std::runtime_error("invalid operation '" + fields[3] + "'");
+                }
+            } catch (const std::invalid_argument&) {
+                throw std::runtime_error("line " + std::to_string(number) + ": invalid number");
+            } catch (const std::runtime_error& ex) {
+                throw std::runtime_error("line " + std::to_string(number) + ": " + ex.what());
+            }
+        }
+        dgraph.build();
+    }
+
+private:
+    char m_delimiter = ' ';
+    double m_time_step = 1;
+    unsigned m_lifetime = 0;
+
+    void split(const std::string& line, std::vector<std::string>& fields) const {
+        fields.clear();
+        std::string field;
+        bool whitespace = m_delimiter == ' ';
+        for (char ch : line) {
+            bool separator = whitespace ? std::isspace(ch) : ch == m_delimiter;
+            if (!separator) {
+                if (ch != '\r') {
+                    field += ch;
+                }
+            } else if (!whitespace || !field.empty()) {
+                fields.push_back(std::move(field));
+                field.clear();
+            }
+        }
+        if (!field.empty() || (!whitespace && !fields.empty())) {
+            fields.push_back(std::move(field));
+        }
+    }
+};
+
+
+/// Imports a dynamic graph from a GraphML document.
+/**
+ * The document is read as a stream of tags, no document tree is built.
+ * Nodes have to be declared before the edges that connect them.
+ *
+ * The time when a node or an edge exists is given by two attributes,
+ * by default named "start" and "end". They can be written either directly
+ * as XML attributes of the element or as GraphML data elements whose key
+ * has the corresponding 'attr.name'. The element exists from the state
+ * of its start time (0 if missing) up to, but not including, the state of its
+ * end time (until the last state if missing). Time is converted to states
+ * using a time step, the same way as in @ref edge_list_reader.
+ *
+ * An edge is never added before both of its nodes exist.
+ *
+ * @sa edge_list_reader
+ */
+class graphml_reader {
+public:
+    graphml_reader() = default;
+
+    /// Sets the names of the attributes holding the start and the end time.
+    void set_time_attributes(std::string start, std::string end) {
+        m_start_name = std::move(start);
+        m_end_name = std::move(end);
+    }
+
+    /// Sets how much time one state represents. Default value is 1.
+    /**
+     * @throw std::invalid_argument If @p step <= 0.
+     */
+    void set_time_step(double step) {
+        if (!(step > 0)) {
+            throw std::invalid_argument("time step has to be positive");
+        }
+        m_time_step = step;
+    }
+
+    /// Adds the modifications described by @p in to @p dgraph and builds it.
+    /**
+     * @throw std::runtime_error If the input is malformed.
+     * @throw invalid_graph If the resulting dynamic graph is invalid.
+     */
+    void operator()(std::istream& in, dynamic_graph& dgraph) const {
+        static constexpr unsigned Forever = std::numeric_limits<unsigned>::max();
+        struct node_entry {
+            node_id id;
+            unsigned start;
+            unsigned end;
+        };
+        struct element {
+            bool is_node = false;
+            std::string id;
+            std::string source;
+            std::string target;
+            unsigned start = 0;
+            unsigned end = Forever;
+        };
+
+        std::unordered_map<std::string, node_entry> nodes;
+        // maps key ids to either the start or the end attribute
+        std::unordered_map<std::string, bool> time_keys;
+        detail::xml_reader xml(in);
+
+        bool inside = false; // inside a node or an edge
+        element current;
+        std::string data_key;
+        std::string data_text;
+        bool in_data = false;
+
+        auto to_state = [this](const std::string& value){
+            return detail::time_to_state(std::stod(value), 0, m_time_step);
+        };
+        auto set_time = [&](element& e, bool is_start, const std::string& value){
+            (is_start ? e.start : e.end) = to_state(value);
+        };
+
+        try {
+            for (auto ev = xml.next(); ev != detail::xml_reader::event::eof; ev = xml.next()) {
+                using event = detail::xml_reader::event;
+                if (ev == event::start) {
+                    const std::string& name = xml.name();
+                    if (name == "key") {
+                        const std::string* id = xml.attribute("id");
+                        const std::string* attr = xml.attribute("attr.name");
+                        if (id && attr && (*attr == m_start_name || *attr == m_end_name)) {
+                            time_keys[*id] = *attr == m_start_name;
+                        }
+                    } else if ((name == "node" || name == "edge") && !inside) {
+                        inside = true;
+                        current = element();
+                        current.is_node = name == "node";
+                        auto take = [&](const char* attr, std::string& to){
+                            const std::string* value = xml.attribute(attr);
+                            if (value) {
+                                to = *value;
+                            }
+                        };
+                        take("id", current.id);
+                        take("source", current.source);
+                        take("target", current.target);
+                        if (const std::string* value = xml.attribute(m_start_name)) {
+                            set_time(current, true, *value);
+                        }
+                        if (const std::string* value = xml.attribute(m_end_name)) {
+                            set_time(current, false, *value);
+                        }
+                    } else if (name == "data" && inside) {
+                        const std::string* key = xml.attribute("key");
+                        in_data = key && time_keys.count(*key);
+                        if (in_data) {
+                            data_key = *key;
+                            data_text.clear();
+                        }
+                    }
+                } else if (ev == event::text) {
+                    if (in_data) {
+                        data_text += xml.text();
+                    }
+                } else if (ev == event::end) {
+                    const std::string& name = xml.name();
+                    if (name == "data" && in_data) {
+                        in_data = false;
+                        set_time(current, time_keys.at(data_key), data_text);
+                    } else if (inside && (name == "node" || name == "edge")) {
+                        inside = false;
+                        if (current.is_node) {
+                            add_node(dgraph, nodes, current);
+                        } else {
+                            add_edge(dgraph, nodes, current);
+                        }
+                    }
+                }
+            }
+        } catch (const std::invalid_argument&) {
+            throw std::runtime_error("invalid time value in GraphML");
+        }
+        dgraph.build();
+    }
+
+private:
+    std::string m_start_name = "start";
+    std::string m_end_name = "end";
+    double m_time_step = 1;
+
+    template<typename Nodes, typename Element>
+    static void add_node(dynamic_graph& dgraph, Nodes& nodes, const Element& e) {
+        if (e.id.empty()) {
+            throw std::runtime_error("GraphML node without an id");
+        }
+        if (nodes.count(e.id)) {
+            throw std::runtime_error("duplicate GraphML node '" + e.id + "'");
+        }
+        node_id id = 0;
+        if (e.start < e.end) {
+            id = dgraph.add_node(e.start);
+            if (e.end != std::numeric_limits<unsigned>::max()) {
+                dgraph.remove_node(e.end, id);
+            }
+        }
+        nodes.emplace(e.id, typename Nodes::mapped_type{ id, e.start, e.end });
+    }
+
+    template<typename Nodes, typename Element>
+    static void add_edge(dynamic_graph& dgraph, const Nodes& nodes, const Element& e) {
+        auto one = nodes.find(e.source);
+        auto two = nodes.find(e.target);
+        if (one == nodes.end() || two == nodes.end()) {
+            throw std::runtime_error("GraphML edge references an unknown node");
+        }
+        unsigned start = std::max({ e.start, one->second.start, two->second.start });
+        // removing a node removes its edges as well
+        unsigned nodes_end = std::min(one->second.end, two->second.end);
+        unsigned end = std::min(e.end, nodes_end);
+        if (start >= end) {
+            return;
+        }
+        edge_id id = dgraph.add_edge(start, one->second.id, two->second.id);
+        if (end < nodes_end) {
+            dgraph.remove_edge(end, id);
+        }
+    }
+};
+
+} // namespace dyng
@@ -39,6 +39,10 @@ public:
             graph.nodes()[i].pos().y = std::sin(i * angle) * radius;
         }
     }
+
+    /// Adds the parameters to a hash, there are none.
+    template<typename Hasher>
+    void hash_parameters(Hasher&) const {}
 };
 
 } // namespace dyng
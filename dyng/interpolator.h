@@ -196,6 +196,23 @@ public:
         return (dgraph.states().size() - 1) * transition_duration();
     }
 
+    /// Memory of the last frame, reused by the next one.
+    /**
+     * Frames of the same transition (between the same two states) only update
+     * positions and alpha values of the last frame, which doesn't allocate.
+     * Call clear() after the dynamic graph is modified.
+     */
+    struct frame_buffer {
+        graph_state state;
+        // the transition the state was built for
+        const dynamic_graph* graph = nullptr;
+        unsigned one = 0;
+        unsigned two = 0;
+
+        /// Forgets the last frame, so that the next one is built again.
+        void clear() { graph = nullptr; }
+    };
+
     /// Returns a graph state representing a single frame of animation.
     /**
      * Interpolates between states and returns corresponding graph_state
@@ -205,6 +222,19 @@ public:
      * @throw std::out_of_range If time < 0 or time > length().
      */
     graph_state operator()(const dynamic_graph& dgraph, float time) const {
+        frame_buffer buffer;
+        (*this)(dgraph, time, buffer);
+        return std::move(buffer.state);
+    }
+
+    /// Same as above, builds the frame in @p buffer and returns it.
+    /**
+     * Rendering consecutive frames into the same buffer avoids copying
+     * the states for every frame.
+     * 
+     * @throw std::out_of_range If time < 0 or time > length().
+     */
+    const graph_state& operator()(const dynamic_graph& dgraph, float time, frame_buffer& buffer) const {
         if (time < 0) {
             throw std::out_of_range("time < 0");
         }
@@ -212,7 +242,9 @@ public:
             throw std::out_of_range("time > length()");
         }
         if (dgraph.states().empty()) {
-            return graph_state();
+            buffer.clear();
+            buffer.state = graph_state();
+            return buffer.state;
         }
         unsigned index_one = std::floor(time / transition_duration());
         unsigned index_two = std::ceil(time / transition_duration());
@@ -230,28 +262,16 @@ public:
 
         index_one = std::min<unsigned>(index_one, dgraph.states().size() - 1);
         index_two = std::min<unsigned>(index_two, dgraph.states().size() - 1);
-        graph_state current_state = dgraph.states()[index_one];
         const graph_state& next_state = dgraph.states()[index_two];
-
-        // add new nodes and edges from the next state
-        for (auto& n : current_state.nodes()) {
-            n.is_new(false);
-        }
-        for (auto& e : current_state.edges()) {
-            e.is_new(false);
-        }
-        for (auto n : next_state.nodes()) {
-            if (n.is_new()) {
-                n.is_old(false);
-                current_state.push_node(n);
-            }
-        }
-        for (auto e : next_state.edges()) {
-            if (e.is_new()) {
-                e.is_old(false);
-                current_state.push_edge(e);
-            }
+        if (buffer.graph == &dgraph && buffer.one == index_one && buffer.two == index_two) {
+            restore(dgraph.states()[index_one], next_state, buffer.state);
+        } else {
+            build(dgraph.states()[index_one], next_state, buffer.state);
+            buffer.graph = &dgraph;
+            buffer.one = index_one;
+            buffer.two = index_two;
         }
+        graph_state& current_state = buffer.state;
 
         // interpolate between the two states and assign alpha values
         for (auto& node : current_state.nodes()) {
@@ -302,6 +322,59 @@ private:
         }
     }
 
+    // the current state with new nodes and edges from the next state
+    void build(const graph_state& current_state, const graph_state& next_state, graph_state& result) const {
+        result = current_state;
+        for (auto& n : result.nodes()) {
+            n.is_new(false);
+        }
+        for (auto& e : result.edges()) {
+            e.is_new(false);
+        }
+        for (auto n : next_state.nodes()) {
+            if (n.is_new()) {
+                n.is_old(false);
+                result.push_node(n);
+            }
+        }
+        for (auto e : next_state.edges()) {
+            if (e.is_new()) {
+                e.is_old(false);
+                result.push_edge(e);
+            }
+        }
+    }
+
+    // resets positions and alpha values of a result of build to those of the two states
+    void restore(const graph_state& current_state, const graph_state& next_state, graph_state& result) const {
+        unsigned n = 0;
+        auto restore_node = [&](const node& source){
+            result.nodes()[n].pos() = source.pos();
+            result.nodes()[n].alpha(source.alpha());
+            ++n;
+        };
+        for (const auto& node : current_state.nodes()) {
+            restore_node(node);
+        }
+        for (const auto& node : next_state.nodes()) {
+            if (node.is_new()) {
+                restore_node(node);
+            }
+        }
+        unsigned e = 0;
+        auto restore_edge = [&](const edge& source){
+            result.edges()[e++].alpha(source.alpha());
+        };
+        for (const auto& edge : current_state.edges()) {
+            restore_edge(edge);
+        }
+        for (const auto& edge : next_state.edges()) {
+            if (edge.is_new()) {
+                restore_edge(edge);
+            }
+        }
+    }
+
     std::pair<float, unsigned> get_current_phase(float time) const {
         for (unsigned i = 0; i < m_phases.size(); ++i) {
             if (time < duration(m_phases[i])) {
@@ -0,0 +1,237 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains a cache of layout results stored on disk, addressed
+ * by a hash of the graph topology and the layout parameters.
+ *
+ * @sa layout_cache,
+ * cached_layout
+ */
+#pragma once
+
+#include "dynamic_graph.h"
+#include "archive.h"
+#include "hash.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio> // std::rename, std::remove
+#include <cstdint>
+#include <thread>
+#include <functional> // std::hash
+#include <utility> // std::move
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DYNG_HAS_GETPID
+#include <unistd.h> // getpid
+#endif
+
+namespace dyng {
+
+/// Stores laid out dynamic graphs in a directory, one archive file per graph.
+/**
+ * A graph is found by its key, which is computed from the sequence of states
+ * (node and edge identifiers in their order, positions are ignored) and from
+ * all parameters of the layout object. Identical input laid out with identical
+ * parameters therefore gets the same key.
+ *
+ * The directory has to exist. Files are written under a temporary name
+ * unique to the process and thread and then renamed, so multiple threads
+ * or processes can share the directory (on systems without getpid only threads).
+ *
+ * The keys depend on the byte representation of the parameters
+ * and are only meant to be used on the same platform.
+ *
+ * @sa cached_layout
+ */
+class layout_cache {
+public:
+    explicit layout_cache(std::string directory)
+            : m_directory(std::move(directory)) {
+        if (!m_directory.empty() && m_directory.back() != '/') {
+            m_directory += '/';
+        }
+    }
+
+    const std::string& directory() const { return m_directory; }
+
+    /// Returns the key of a graph that would be laid out by a given layout object.
+    /**
+     * @tparam Layout A layout object with the method 'hash_parameters',
+     * like @ref foresighted_layout.
+     */
+    template<typename Layout>
+    std::string key(const dynamic_graph& dgraph, const Layout& layout) const {
+        detail::fnv_hash hasher;
+        hasher.add(FormatVersion);
+        hasher.add(static_cast<std::uint64_t>(dgraph.states().size()));
+        for (const auto& state : dgraph.states()) {
+            hasher.add(static_cast<std::uint64_t>(state.nodes().size()));
+            for (const auto& n : state.nodes()) {
+                hasher.add(n.id().value);
+            }
+            hasher.add(static_cast<std::uint64_t>(state.edges().size()));
+            for (const auto& e : state.edges()) {
+                hasher.add(e.id().value);
+                hasher.add(e.one_id().value);
+                hasher.add(e.two_id().value);
+            }
+        }
+        layout.hash_parameters(hasher);
+        return to_hex(hasher.value());
+    }
+
+    /// Sets the positions of nodes in @p dgraph to those stored under @p key.
+    /**
+     * @return False if there is no usable entry, @p dgraph is then left unchanged.
+     */
+    bool load(const std::string& key, dynamic_graph& dgraph) const {
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::vector<graph_state> states;
+        try {
+            archive_reader reader(file);
+            if (reader.state_count() != dgraph.states().size()) {
+                return false;
+            }
+            states = reader.states(0, reader.state_count());
+        } catch (const std::runtime_error&) {
+            // a damaged entry is the same as a missing one
+            return false;
+        }
+        for (unsigned s = 0; s < states.size(); ++s) {
+            const auto& stored = states[s];
+            const auto& state = dgraph.states()[s];
+            if (stored.nodes().size() != state.nodes().size()) {
+                return false;
+            }
+            for (const auto& n : state.nodes()) {
+                if (!stored.node_exists(n.id())) {
+                    return false;
+                }
+            }
+        }
+        for (unsigned s = 0; s < states.size(); ++s) {
+            auto& state = dgraph.states()[s];
+            for (auto& n : state.nodes()) {
+                n.pos() = states[s].node_at(n.id()).pos();
+            }
+        }
+        return true;
+    }
+
+    /// Stores a laid out graph under @p key.
+    /**
+     * @return False if the file could not be written.
+     */
+    bool store(const std::string& key, const dynamic_graph& dgraph) const {
+        std::string target = path(key);
+        // the process id keeps processes apart, thread ids repeat across them
+        std::string temporary = target + ".tmp" + to_hex(process_id()) + "-"
+                + to_hex(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            if (!file) {
+                return false;
+            }
+            archive_writer().write(file, dgraph);
+            if (!file.flush()) {
+                file.close();
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+        if (std::rename(temporary.c_str(), target.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // changes whenever the layout algorithms change their results
+    static constexpr std::uint32_t FormatVersion = 2;
+
+    std::string m_directory;
+
+    std::string path(const std::string& key) const {
+        return m_directory + key + ".dyng";
+    }
+
+    static std::uint64_t process_id() {
+#if defined(DYNG_HAS_GETPID)
+        return static_cast<std::uint64_t>(::getpid());
+#else
+        return 0;
+#endif
+    }
+
+    static std::string to_hex(std::uint64_t value) {
+        static const char digits[] = "0123456789abcdef";
+        std::string result(16, '0');
+        for (unsigned i = 0; i < 16; ++i) {
+            result[15 - i] = digits[value & 0xf];
+            value >>= 4;
+        }
+        return result;
+    }
+};
+
+
+/// Function object that looks up a layout in a cache before computing it.
+/**
+ * Can be used in place of the wrapped layout object. On a cache hit
+ * no layout work is done, on a miss the result is stored in the cache.
+ * A failure to store the result is ignored.
+ *
+ * @sa layout_cache
+ */
+template<typename Layout>
+class cached_layout {
+public:
+    cached_layout(Layout layout, layout_cache cache)
+            : m_layout(std::move(layout))
+            , m_cache(std::move(cache)) {}
+
+    /// Performs the algorithm on a dynamic graph or loads the result from the cache.
+    void operator()(dynamic_graph& dgraph) {
+        std::string key = m_cache.key(dgraph, m_layout);
+        if (m_cache.load(key, dgraph)) {
+            ++m_hits;
+            return;
+        }
+        m_layout(dgraph);
+        m_cache.store(key, dgraph);
+    }
+
+    /// Returns the number of graphs loaded from the cache.
+    unsigned hits() const { return m_hits; }
+
+    const Layout& layout() const { return m_layout; }
+    Layout& layout() { return m_layout; }
+
+private:
+    Layout m_layout;
+    layout_cache m_cache;
+    unsigned m_hits = 0;
+};
+
+} // namespace dyng
@@ -0,0 +1,425 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains metrics of the quality of layouts, of single graph states
+ * and of whole dynamic graphs.
+ *
+ * @sa measure_quality
+ */
+#pragma once
+
+#include "graph.h"
+#include "dynamic_graph.h"
+
+#include <vector>
+#include <queue>
+#include <random>
+#include <algorithm> // std::min, std::max
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <limits>
+
+namespace dyng {
+
+/// Calculates the euclidean mental distance between two layouts.
+/**
+ * The sum of distances between the positions of nodes present in both states;
+ * divided by the number of such nodes if @p relative is true.
+ * This is the measure used by tolerance in @ref foresighted_layout.
+ */
+inline float mental_distance(const graph_state& one, const graph_state& two, bool relative = true) {
+    float result = 0;
+    unsigned count = 0;
+    for (const auto& node : one.nodes()) {
+        if (two.node_exists(node.id())) {
+            const auto& other = two.node_at(node.id());
+            float diff_x = node.pos().x - other.pos().x;
+            float diff_y = node.pos().y - other.pos().y;
+            result += std::sqrt(diff_x * diff_x + diff_y * diff_y);
+            ++count;
+        }
+    }
+    if (relative) {
+        return result / static_cast<float>(count);
+    }
+    return result;
+}
+
+/// Returns the mental distances between all consecutive states of a dynamic graph.
+inline std::vector<float> mental_distance_profile(const dynamic_graph& dgraph, bool relative = true) {
+    std::vector<float> result;
+    const auto& states = dgraph.states();
+    for (unsigned s = 1; s < states.size(); ++s) {
+        result.push_back(mental_distance(states[s - 1], states[s], relative));
+    }
+    return result;
+}
+
+
+namespace detail {
+
+/// A uniform grid over the bounding box of a layout, used to find nearby elements.
+class bounding_grid {
+public:
+    /// Creates a grid with about @p cells cells over the bounding box of the nodes.
+    bounding_grid(const graph_state& state, unsigned cells) {
+        m_min = coords{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+        coords max{ std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+        for (const auto& n : state.nodes()) {
+            m_min.x = std::min(m_min.x, n.pos().x);
+            m_min.y = std::min(m_min.y, n.pos().y);
+            max.x = std::max(max.x, n.pos().x);
+            max.y = std::max(max.y, n.pos().y);
+        }
+        float w = std::max(max.x - m_min.x, 1e-6f);
+        float h = std::max(max.y - m_min.y, 1e-6f);
+        m_cell = std::max(std::sqrt(w * h / std::max(cells, 1u)), 1e-6f);
+        m_columns = static_cast<unsigned>(w / m_cell) + 1;
+        m_rows = static_cast<unsigned>(h / m_cell) + 1;
+        m_items.resize(m_columns * m_rows);
+    }
+
+    unsigned column(float x) const {
+        return std::min(static_cast<unsigned>(std::max(x - m_min.x, 0.0f) / m_cell), m_columns - 1);
+    }
+
+    unsigned row(float y) const {
+        return std::min(static_cast<unsigned>(std::max(y - m_min.y, 0.0f) / m_cell), m_rows - 1);
+    }
+
+    /// Returns the lowest y coordinate of row @p r.
+    float row_start(unsigned r) const { return m_min.y + r * m_cell; }
+
+    std::vector<unsigned>& at(unsigned c, unsigned r) { return m_items[r * m_columns + c]; }
+
+    unsigned columns() const { return m_columns; }
+    unsigned rows() const { return m_rows; }
+    float cell() const { return m_cell; }
+
+private:
+    coords m_min;
+    float m_cell;
+    unsigned m_columns;
+    unsigned m_rows;
+    std::vector<std::vector<unsigned>> m_items;
+};
+
+// the sign of the cross product of (b - a) and (c - a)
+inline int orientation(coords a, coords b, coords c) {
+    float value = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    return (value > 0) - (value < 0);
+}
+
+} // namespace detail
+
+
+/// Counts pairs of edges that cross each other.
+/**
+ * Only proper crossings are counted; edges sharing a node, touching
+ * or overlapping along a line are not. Every edge is put into the cells
+ * of a grid it passes through, walked row by row, and only edges sharing
+ * a cell are tested, every pair in the first cell they share. A long edge
+ * therefore takes about as many cells as it is long, not as its bounding box
+ * is large, and the time is close to linear for layouts with edges of
+ * similar length.
+ */
+inline std::uint64_t edge_crossings(const graph_state& state) {
+    const auto& edges = state.edges();
+    if (edges.size() < 2) {
+        return 0;
+    }
+    detail::bounding_grid grid(state, edges.size());
+    struct segment {
+        coords one;
+        coords two;
+        unsigned begin, end; // range of its cells, in increasing order
+    };
+    std::vector<segment> segments;
+    segments.reserve(edges.size());
+    std::vector<unsigned> cells;
+    // a little wider than the segment, so that rounding cannot miss a cell
+    float pad = grid.cell() * 1e-3f;
+    for (unsigned i = 0; i < edges.size(); ++i) {
+        coords one = state.node_at(edges[i].one_id()).pos();
+        coords two = state.node_at(edges[i].two_id()).pos();
+        segment s{ one, two, static_cast<unsigned>(cells.size()), 0 };
+        float low = std::min(one.y, two.y);
+        float high = std::max(one.y, two.y);
+        unsigned max_r = grid.row(high);
+        for (unsigned r = grid.row(low); r <= max_r; ++r) {
+            float from_x = std::min(one.x, two.x);
+            float to_x = std::max(one.x, two.x);
+            if (one.y != two.y) {
+                // the part of the segment within the row
+                float top = std::max(low, grid.row_start(r));
+                float bottom = std::min(high, grid.row_start(r + 1));
+                float slope = (two.x - one.x) / (two.y - one.y);
+                float x1 = one.x + (top - one.y) * slope;
+                float x2 = one.x + (bottom - one.y) * slope;
+                from_x = std::max(from_x, std::min(x1, x2));
+                to_x = std::min(to_x, std::max(x1, x2));
+            }
+            unsigned max_c = grid.column(to_x + pad);
+            for (unsigned c = grid.column(from_x - pad); c <= max_c; ++c) {
+                grid.at(c, r).push_back(i);
+                cells.push_back(r * grid.columns() + c);
+            }
+        }
+        s.end = static_cast<unsigned>(cells.size());
+        segments.push_back(s);
+    }
+    // the first cell two segments share, both ranges are sorted
+    auto first_shared = [&](const segment& a, const segment& b) {
+        unsigned i = a.begin;
+        unsigned j = b.begin;
+        while (cells[i] != cells[j]) {
+            if (cells[i] < cells[j]) {
+                ++i;
+            } else {
+                ++j;
+            }
+        }
+        return cells[i];
+    };
+    std::uint64_t result = 0;
+    for (unsigned r = 0; r < grid.rows(); ++r) {
+        for (unsigned c = 0; c < grid.columns(); ++c) {
+            const auto& cell = grid.at(c, r);
+            for (unsigned a = 0; a < cell.size(); ++a) {
+                for (unsigned b = a + 1; b < cell.size(); ++b) {
+                    const auto& ea = edges[cell[a]];
+                    const auto& eb = edges[cell[b]];
+                    if (ea.one_id() == eb.one_id() || ea.one_id() == eb.two_id()
+                            || ea.two_id() == eb.one_id() || ea.two_id() == eb.two_id()) {
+                        continue;
+                    }
+                    const segment& sa = segments[cell[a]];
+                    const segment& sb = segments[cell[b]];
+                    int o1 = detail::orientation(sa.one, sa.two, sb.one);
+                    int o2 = detail::orientation(sa.one, sa.two, sb.two);
+                    int o3 = detail::orientation(sb.one, sb.two, sa.one);
+                    int o4 = detail::orientation(sb.one, sb.two, sa.two);
+                    // count the pair only in the first cell both segments pass through
+                    if (o1 * o2 < 0 && o3 * o4 < 0
+                            && first_shared(sa, sb) == r * grid.columns() + c) {
+                        ++result;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/// Counts pairs of nodes closer to each other than @p min_distance.
+inline std::uint64_t node_overlaps(const graph_state& state, float min_distance) {
+    const auto& nodes = state.nodes();
+    if (nodes.size() < 2 || min_distance <= 0) {
+        return 0;
+    }
+    detail::bounding_grid grid(state, nodes.size());
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+        grid.at(grid.column(nodes[i].pos().x), grid.row(nodes[i].pos().y)).push_back(i);
+    }
+    // neighbours within the distance are at most this many cells away
+    unsigned reach = static_cast<unsigned>(min_distance / grid.cell()) + 1;
+    std::uint64_t result = 0;
+    float limit = min_distance * min_distance;
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+        const auto& pos = nodes[i].pos();
+        unsigned c = grid.column(pos.x);
+        unsigned r = grid.row(pos.y);
+        for (unsigned y = r > reach ? r - reach : 0; y <= std::min(r + reach, grid.rows() - 1); ++y) {
+            for (unsigned x = c > reach ? c - reach : 0; x <= std::min(c + reach, grid.columns() - 1); ++x) {
+                for (unsigned j : grid.at(x, y)) {
+                    if (j <= i) {
+                        continue;
+                    }
+                    float dx = nodes[j].pos().x - pos.x;
+                    float dy = nodes[j].pos().y - pos.y;
+                    if (dx * dx + dy * dy < limit) {
+                        ++result;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/// Returns the variance of edge lengths divided by the squared mean length.
+/**
+ * Being normalized, it doesn't depend on the size of the canvas;
+ * 0 means that all edges have the same length.
+ */
+inline double edge_length_variance(const graph_state& state) {
+    if (state.edges().empty()) {
+        return 0;
+    }
+    double sum = 0;
+    double sum_squares = 0;
+    for (const auto& e : state.edges()) {
+        const auto& one = state.node_at(e.one_id()).pos();
+        const auto& two = state.node_at(e.two_id()).pos();
+        double length = std::hypot(two.x - one.x, two.y - one.y);
+        sum += length;
+        sum_squares += length * length;
+    }
+    double n = state.edges().size();
+    double mean = sum / n;
+    if (mean == 0) {
+        return 0;
+    }
+    return std::max(sum_squares / n - mean * mean, 0.0) / (mean * mean);
+}
+
+/// Returns the normalized stress of a layout, estimated on pairs from sampled sources.
+/**
+ * Graph distances are found by breadth-first search from @p samples randomly
+ * chosen nodes to all nodes reachable from them. The layout is first scaled
+ * optimally, so the result doesn't depend on the size of the canvas;
+ * 0 means that euclidean distances are proportional to graph distances.
+ *
+ * @param seed The seed of the choice of sources, so results are repeatable.
+ */
+inline double sampled_stress(const graph_state& state, unsigned samples = 32, unsigned seed = 0) {
+    const auto& nodes = state.nodes();
+    if (nodes.size() < 2) {
+        return 0;
+    }
+    // adjacency in the compressed form
+    std::vector<unsigned> begin(nodes.size() + 1, 0);
+    for (const auto& e : state.edges()) {
+        ++begin[state.node_index(e.one_id()) + 1];
+        ++begin[state.node_index(e.two_id()) + 1];
+    }
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+        begin[i + 1] += begin[i];
+    }
+    std::vector<unsigned> adjacent(begin.back());
+    std::vector<unsigned> fill(begin.begin(), begin.end() - 1);
+    for (const auto& e : state.edges()) {
+        unsigned one = state.node_index(e.one_id());
+        unsigned two = state.node_index(e.two_id());
+        adjacent[fill[one]++] = two;
+        adjacent[fill[two]++] = one;
+    }
+
+    std::mt19937 rand_gen(seed);
+    std::uniform_int_distribution<unsigned> pick(0, nodes.size() - 1);
+    // sums for the optimal scale s minimizing sum ((s * e - d) / d)^2
+    double sum_ratio = 0;
+    double sum_ratio_squares = 0;
+    std::vector<std::pair<double, double>> pairs; // euclidean, graph distance
+    std::vector<unsigned> distance(nodes.size());
+    std::queue<unsigned> queue;
+    for (unsigned s = 0; s < std::min<unsigned>(samples, nodes.size()); ++s) {
+        unsigned source = samples >= nodes.size() ? s : pick(rand_gen);
+        std::fill(distance.begin(), distance.end(), 0);
+        distance[source] = 1; // stored increased by one, 0 means unvisited
+        queue.push(source);
+        while (!queue.empty()) {
+            unsigned current = queue.front();
+            queue.pop();
+            for (unsigned a = begin[current]; a < begin[current + 1]; ++a) {
+                unsigned next = adjacent[a];
+                if (distance[next] == 0) {
+                    distance[next] = distance[current] + 1;
+                    queue.push(next);
+                }
+            }
+        }
+        for (unsigned i = 0; i < nodes.size(); ++i) {
+            if (i == source || distance[i] == 0) {
+                continue;
+            }
+            double d = distance[i] - 1;
+            double e = std::hypot(nodes[i].pos().x - nodes[source].pos().x,
+                    nodes[i].pos().y - nodes[source].pos().y);
+            sum_ratio += e / d;
+            sum_ratio_squares += (e / d) * (e / d);
+            pairs.emplace_back(e, d);
+        }
+    }
+    if (pairs.empty() || sum_ratio_squares == 0) {
+        return 0;
+    }
+    double scale = sum_ratio / sum_ratio_squares;
+    double result = 0;
+    for (const auto& p : pairs) {
+        double diff = (scale * p.first - p.second) / p.second;
+        result += diff * diff;
+    }
+    return result / pairs.size();
+}
+
+
+/// Quality of the layout of a dynamic graph, see @ref measure_quality.
+struct layout_quality {
+    /// Edge crossings summed over all states.
+    std::uint64_t crossings = 0;
+    /// Pairs of overlapping nodes summed over all states.
+    std::uint64_t overlaps = 0;
+    /// Sampled stress averaged over the states.
+    double stress = 0;
+    /// Normalized edge length variance averaged over the states.
+    double edge_length_variance = 0;
+    /// The mean and the maximum of relative mental distances of consecutive states.
+    double mean_mental_distance = 0;
+    double max_mental_distance = 0;
+};
+
+/// Computes all quality metrics of a laid out dynamic graph.
+/**
+ * @param min_distance Nodes closer than this are counted as overlapping.
+ * @param samples The number of sources used to estimate stress in every state.
+ */
+inline layout_quality measure_quality(const dynamic_graph& dgraph
+        , float min_distance
+        , unsigned samples = 32) {
+    layout_quality result;
+    const auto& states = dgraph.states();
+    if (states.empty()) {
+        return result;
+    }
+    for (const auto& state : states) {
+        result.crossings += edge_crossings(state);
+        result.overlaps += node_overlaps(state, min_distance);
+        result.stress += sampled_stress(state, samples);
+        result.edge_length_variance += edge_length_variance(state);
+    }
+    result.stress /= states.size();
+    result.edge_length_variance /= states.size();
+    auto profile = mental_distance_profile(dgraph);
+    unsigned counted = 0;
+    for (float d : profile) {
+        // states without common nodes have no distance
+        if (std::isfinite(d)) {
+            result.mean_mental_distance += d;
+            result.max_mental_distance = std::max<double>(result.max_mental_distance, d);
+            ++counted;
+        }
+    }
+    if (counted > 0) {
+        result.mean_mental_distance /= counted;
+    }
+    return result;
+}
+
+} // namespace dyng
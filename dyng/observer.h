@@ -0,0 +1,255 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains the interface used to observe the phases of layout
+ * algorithms, the observer that does nothing (used by default)
+ * and an observer that collects totals.
+ *
+ * @sa no_observer,
+ * phase_statistics
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory> // std::shared_ptr
+#include <cstdint>
+
+namespace dyng {
+
+/// A phase of a layout computation reported to an observer.
+enum class layout_phase : unsigned {
+    node_live_times,
+    edge_live_times,
+    supergraph,
+    gap,
+    rgap,
+    /// The whole static layout of the graph representing all states.
+    static_layout,
+    /// A single pass of the static layout algorithm with one cooling schedule.
+    static_pass,
+    positions,
+    tolerance,
+    /// A single cooling round of tolerance.
+    tolerance_round,
+    /// An iteration of tolerance on one state, the item is the index of the state.
+    state_iteration,
+    /// The sequential decision which states of a round are accepted.
+    accept,
+    rescale,
+    count_ // the number of phases
+};
+
+/// Returns a readable name of a phase.
+inline const char* phase_name(layout_phase p) {
+    static const char* names[] = { "node live times", "edge live times", "supergraph",
+            "gap", "rgap", "static layout", "static pass", "positions", "tolerance",
+            "tolerance round", "state iteration", "accept", "rescale" };
+    static_assert(sizeof(names) / sizeof(*names) == static_cast<unsigned>(layout_phase::count_),
+            "a name for every phase");
+    return names[static_cast<unsigned>(p)];
+}
+
+/// A quantity counted during a layout computation.
+enum class layout_counter : unsigned {
+    /// Iterations of the static layout algorithm.
+    iterations,
+    /// Pairs of nodes whose repulsion was evaluated.
+    pairs,
+    /// Improved states accepted by tolerance.
+    accepted,
+    /// Improved states rejected by tolerance.
+    rejected,
+    /// Bytes of graph states copied by tolerance (estimated from element counts).
+    bytes_copied,
+    count_ // the number of counters
+};
+
+/// The state of the static layout after one iteration, reported to observers that want it.
+/**
+ * Lengths are relative to the canvas in the same way as temperatures,
+ * see fruchterman_reingold::relative_unit.
+ */
+struct iteration_sample {
+    /// The temperature of the iteration.
+    float temperature = 0;
+    /// The energy of the layout after the iteration, the potential of the forces of the algorithm.
+    double energy = 0;
+    /// The sum and the maximum of distances the nodes moved by (before keeping them on the canvas).
+    double displacement = 0;
+    double max_displacement = 0;
+    /// The number of nodes.
+    unsigned nodes = 0;
+};
+
+/// Observer that ignores everything, used when no observer is wanted.
+/**
+ * An observer is a class with the same members as this one and 'enabled'
+ * set to true. Layout objects take it as a template parameter and call it
+ * at the boundaries of phases; with this class every call and all work
+ * needed to prepare it are removed by the compiler.
+ *
+ * Parallel layouts call the observer from multiple threads at the same time,
+ * so an observer used with them has to be thread-safe.
+ * Layout objects hold their observer by value and copy it when they are copied.
+ *
+ * @sa phase_statistics
+ */
+struct no_observer {
+    static constexpr bool enabled = false;
+    /// If true, the static layout computes an iteration_sample after every iteration.
+    static constexpr bool samples_iterations = false;
+
+    /// Called when a phase starts.
+    void begin(layout_phase) {}
+
+    /// Called when a phase ends, with its duration in seconds.
+    /**
+     * @p item identifies the part of the input the phase worked on,
+     * like the index of a state; 0 if it is not applicable.
+     */
+    void end(layout_phase, double, unsigned) {}
+
+    /// Adds @p value to a counter.
+    void count(layout_counter, std::uint64_t) {}
+
+    /// Called after every iteration of the static layout if samples_iterations is true.
+    void sample(const iteration_sample&) {}
+};
+
+
+/// Observer that sums the durations of phases and the counters.
+/**
+ * Copies share the same totals, so the totals can be read from a copy
+ * kept outside of the layout object. Thread-safe.
+ *
+ * For example:
+ *
+ *     dyng::phase_statistics stats;
+ *     dyng::foresighted_layout<
+ *             dyng::fruchterman_reingold<dyng::initial_placement, dyng::phase_statistics>,
+ *             dyng::phase_statistics> layout;
+ *     layout.set_observer(stats);
+ *     layout.static_layout().set_observer(stats);
+ *     layout(dgraph);
+ *     double seconds = stats.seconds(dyng::layout_phase::tolerance);
+ */
+class phase_statistics {
+public:
+    static constexpr bool enabled = true;
+    static constexpr bool samples_iterations = false;
+
+    phase_statistics()
+            : m_totals(std::make_shared<totals>()) {}
+
+    void begin(layout_phase) {}
+
+    void end(layout_phase p, double seconds, unsigned) {
+        auto& slot = m_totals->phases[static_cast<unsigned>(p)];
+        // atomic add of a double
+        double current = slot.seconds;
+        while (!slot.seconds.compare_exchange_weak(current, current + seconds)) {}
+        ++slot.calls;
+    }
+
+    void count(layout_counter c, std::uint64_t value) {
+        m_totals->counters[static_cast<unsigned>(c)] += value;
+    }
+
+    void sample(const iteration_sample&) {}
+
+    /// Returns the total time spent in a phase, in seconds.
+    double seconds(layout_phase p) const {
+        return m_totals->phases[static_cast<unsigned>(p)].seconds;
+    }
+
+    /// Returns how many times a phase ended.
+    std::uint64_t calls(layout_phase p) const {
+        return m_totals->phases[static_cast<unsigned>(p)].calls;
+    }
+
+    /// Returns the value of a counter.
+    std::uint64_t value(layout_counter c) const {
+        return m_totals->counters[static_cast<unsigned>(c)];
+    }
+
+    /// Sets all totals to zero.
+    void reset() {
+        for (auto& slot : m_totals->phases) {
+            slot.seconds = 0;
+            slot.calls = 0;
+        }
+        for (auto& c : m_totals->counters) {
+            c = 0;
+        }
+    }
+
+private:
+    struct phase_total {
+        std::atomic<double> seconds{ 0 };
+        std::atomic<std::uint64_t> calls{ 0 };
+    };
+
+    struct totals {
+        phase_total phases[static_cast<unsigned>(layout_phase::count_)];
+        std::atomic<std::uint64_t> counters[static_cast<unsigned>(layout_counter::count_)]{};
+    };
+
+    std::shared_ptr<totals> m_totals;
+};
+
+
+namespace detail {
+
+/// Reports a phase to an observer for the lifetime of this object.
+template<typename Observer, bool Enabled = Observer::enabled>
+class scoped_phase {
+public:
+    scoped_phase(Observer& observer, layout_phase p, unsigned item = 0)
+            : m_observer(observer)
+            , m_phase(p)
+            , m_item(item)
+            , m_start(std::chrono::steady_clock::now()) {
+        m_observer.begin(m_phase);
+    }
+
+    scoped_phase(const scoped_phase&) = delete;
+    scoped_phase& operator=(const scoped_phase&) = delete;
+
+    ~scoped_phase() {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+        m_observer.end(m_phase, elapsed.count(), m_item);
+    }
+
+private:
+    Observer& m_observer;
+    layout_phase m_phase;
+    unsigned m_item;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// nothing is measured without an observer
+template<typename Observer>
+class scoped_phase<Observer, false> {
+public:
+    scoped_phase(Observer&, layout_phase, unsigned = 0) {}
+};
+
+} // namespace detail
+
+} // namespace dyng
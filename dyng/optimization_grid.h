@@ -43,46 +43,75 @@ public:
     void add(coords pos, unsigned index) {
         int x = std::floor((pos.x + m_w * 0.5f) / m_2k);
         int y = std::floor((pos.y + m_h * 0.5f) / m_2k);
-        get(x, y).push_back(index);
+        m_added.push_back({ static_cast<unsigned>(y * m_grid_w + x), index });
+    }
+
+    /// Groups the added nodes by cells, call it after the last add and before for_each_around.
+    /**
+     * Nodes of a cell keep the order in which they were added.
+     */
+    void sort() {
+        std::size_t cells = m_grid_w * m_grid_h;
+        m_begin.assign(cells + 2, 0);
+        for (const auto& a : m_added) {
+            ++m_begin[a.cell + 2];
+        }
+        for (std::size_t c = 2; c < cells + 2; ++c) {
+            m_begin[c] += m_begin[c - 1];
+        }
+        m_indices.resize(m_added.size());
+        for (const auto& a : m_added) {
+            m_indices[m_begin[a.cell + 1]++] = a.index;
+        }
     }
 
     template<typename Function>
-    void for_each_around(coords pos, Function func) {
+    void for_each_around(coords pos, Function func) const {
         int pos_x = std::floor((pos.x + m_w * 0.5f) / m_2k);
         int pos_y = std::floor((pos.y + m_h * 0.5f) / m_2k);
         for (int y = std::max(pos_y - 1, 0); y <= std::min(pos_y + 1, m_grid_h - 1); ++y) {
             for (int x = std::max(pos_x - 1, 0); x <= std::min(pos_x + 1, m_grid_w - 1); ++x) {
-                for (auto& i : get(x, y)) {
-                    func(i);
+                unsigned cell = y * m_grid_w + x;
+                for (unsigned i = m_begin[cell]; i < m_begin[cell + 1]; ++i) {
+                    func(m_indices[i]);
                 }
             }
         }
     }
 
+    /// Removes all nodes, the grid keeps its memory.
     void clear() {
+        m_added.clear();
         m_indices.clear();
+        m_begin.clear();
     }
 
+    /// Removes all nodes and sets new dimensions, so that a grid can be reused.
     void reset(float w, float h, float k) {
+        clear();
         m_2k = 2.0f * k;
         m_w = w;
         m_h = h;
         m_grid_w = std::ceil(w / m_2k);
         m_grid_h = std::ceil(h / m_2k);
-        m_indices.resize(m_grid_w * m_grid_h);
     }
 
 private:
+    struct entry {
+        unsigned cell;
+        unsigned index;
+    };
+
     float m_2k = 0;
     float m_w = 0;
     float m_h = 0;
     int m_grid_w = 0;
     int m_grid_h = 0;
-    std::vector<std::vector<unsigned>> m_indices;
-
-    std::vector<unsigned>& get(int x, int y) {
-        return m_indices[y * m_grid_w + x];
-    }
+    // nodes in the order of add
+    std::vector<entry> m_added;
+    // nodes sorted by cells, cell c holds m_indices[m_begin[c]] to m_indices[m_begin[c + 1] - 1]
+    std::vector<unsigned> m_begin;
+    std::vector<unsigned> m_indices;
 };
 
 } // namespace detail
@@ -18,133 +18,471 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <functional>
+#include <atomic>
 #include <vector>
 #include <memory> // std::unique_ptr
 #include <utility> // std::move
+#include <exception> // std::exception_ptr
+#include <stdexcept> // std::invalid_argument
+#include <algorithm> // std::max
 #include <cmath> // std::ceil
+#include <string>
+#include <fstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace dyng {
 
 namespace detail {
 
+/// How threads wait for each other.
+enum class wait_policy {
+    /// Go to sleep right away; no CPU time is spent waiting.
+    block,
+    /// Spin for a short time before going to sleep; lower latency when the wait is short.
+    spin
+};
+
+// tells the CPU that this is a busy-wait loop
+inline void cpu_pause() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/// Spins until the predicate holds, but only for a bounded number of iterations.
+/**
+ * @return True if the predicate holds, false if the caller should go to sleep.
+ */
+template<typename Predicate>
+bool spin_until(wait_policy policy, Predicate predicate) {
+    constexpr unsigned SpinCount = 1 << 12;
+    if (policy == wait_policy::spin) {
+        for (unsigned i = 0; i < SpinCount; ++i) {
+            if (predicate()) {
+                return true;
+            }
+            cpu_pause();
+        }
+    }
+    return predicate();
+}
+
 // (unfortunately std::barrier exists since C++20, so cannot be used here)
-// using this method (generations) from Boost barrier implementation:
-// https://stackoverflow.com/questions/24465533/implementing-boostbarrier-in-c11
-// https://stackoverflow.com/questions/26190853/why-does-the-boost-library-use-an-m-generation-variable-in-its-implementation-of
-/// A barrier for thread synchronization.
+/// A sense-reversing barrier for thread synchronization.
+/**
+ * The last thread to arrive flips the shared sense, the others wait for
+ * the sense to differ from the one they saw on arrival. Depending on the policy
+ * they spin for a while first, and then sleep on a condition variable.
+ * The mutex is only touched when some thread actually sleeps.
+ */
 class barrier {
 public:
-    barrier(unsigned count)
-            : m_size(count)
+    barrier(unsigned count, wait_policy policy = wait_policy::block)
+            : m_policy(policy)
+            , m_size(count)
             , m_current(count) {}
 
     void reset(unsigned count) {
         m_size = count;
         m_current = count;
-        m_gen = 0;
     }
 
     void wait() {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        unsigned gen = m_gen;
+        bool sense = m_sense.load();
         if (--m_current == 0) {
-            ++m_gen;
-            m_current = m_size;
-            m_cv.notify_all();
-        } else {
-            m_cv.wait(lock, [this, gen](){ return gen != m_gen; });
+            m_current = m_size.load();
+            m_sense = !sense;
+            if (m_sleeping > 0) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_cv.notify_all();
+            }
+            return;
+        }
+        auto released = [this, sense](){ return m_sense != sense; };
+        if (spin_until(m_policy, released)) {
+            return;
         }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_sleeping;
+        m_cv.wait(lock, released);
+        --m_sleeping;
     }
 
 private:
+    wait_policy m_policy;
+    std::atomic<unsigned> m_size;
+    std::atomic<unsigned> m_current;
+    std::atomic<bool> m_sense{ false };
+    std::atomic<unsigned> m_sleeping{ 0 };
     std::mutex m_mutex;
     std::condition_variable m_cv;
-    unsigned m_size;
-    unsigned m_current = 0;
-    unsigned m_gen = 0;
 };
 
 
-/// A thread pool.
+// parses a list of CPUs in the format of sysfs, e.g. "0-3,8,10-11"
+inline std::vector<unsigned> parse_cpu_list(const std::string& list) {
+    std::vector<unsigned> result;
+    std::size_t pos = 0;
+    while (pos < list.size()) {
+        std::size_t end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(pos, end - pos);
+        pos = end + 1;
+        if (range.empty() || range[0] < '0' || range[0] > '9') {
+            continue;
+        }
+        std::size_t dash = range.find('-');
+        unsigned first = std::stoul(range.substr(0, dash));
+        unsigned last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (unsigned cpu = first; cpu <= last; ++cpu) {
+            result.push_back(cpu);
+        }
+    }
+    return result;
+}
+
+/// Returns the CPUs this process can run on, CPUs of the same NUMA node next to each other.
+/**
+ * Returns an empty vector if this is not supported on the platform.
+ */
+inline std::vector<unsigned> cpus_by_node() {
+    std::vector<unsigned> result;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return result;
+    }
+    std::vector<bool> added(CPU_SETSIZE);
+    auto add = [&](unsigned cpu){
+        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && !added[cpu]) {
+            added[cpu] = true;
+            result.push_back(cpu);
+        }
+    };
+    for (unsigned node = 0; ; ++node) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!std::getline(file, list)) {
+            break;
+        }
+        for (unsigned cpu : parse_cpu_list(list)) {
+            add(cpu);
+        }
+    }
+    // without NUMA information (or CPUs missing in it) the order doesn't matter
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        add(cpu);
+    }
+#endif
+    return result;
+}
+
+/// Restricts a thread to a single CPU. Returns false if it failed or is not supported.
+inline bool pin_thread(std::thread& th, unsigned cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(th.native_handle(), sizeof(set), &set) == 0;
+#else
+    (void)th;
+    (void)cpu;
+    return false;
+#endif
+}
+
+
+/// A double-ended queue in a circular buffer.
 /**
- * Used internally by @ref parallel_foresighted_layout.
+ * The buffer only grows, so once it is large enough, pushing and popping
+ * never allocates (unlike std::deque, which allocates and frees blocks
+ * as the elements move).
  */
-class parallel {
+template<typename T>
+class ring_buffer {
+public:
+    bool empty() const { return m_head == m_tail; }
+    std::size_t size() const { return m_tail - m_head; }
+
+    void push_back(const T& value) {
+        if (size() == m_items.size()) {
+            grow();
+        }
+        m_items[m_tail++ & mask()] = value;
+    }
+
+    T pop_back() { return m_items[--m_tail & mask()]; }
+    T pop_front() { return m_items[m_head++ & mask()]; }
+
+private:
+    static constexpr std::size_t InitialSize = 64;
+
+    // the size is always a power of two, indices are masked
+    std::vector<T> m_items;
+    std::size_t m_head = 0;
+    std::size_t m_tail = 0;
+
+    std::size_t mask() const { return m_items.size() - 1; }
 
-struct param {
-    std::function<void()> func;
-    bool run{ false };
+    void grow() {
+        std::vector<T> bigger(std::max(m_items.size() * 2, InitialSize));
+        for (std::size_t i = m_head; i < m_tail; ++i) {
+            bigger[i - m_head] = m_items[i & mask()];
+        }
+        m_tail -= m_head;
+        m_head = 0;
+        m_items.swap(bigger);
+    }
 };
 
+
+/// A work-stealing thread pool.
+/**
+ * Every worker thread owns a deque of tasks. Tasks spawned by a worker go to
+ * the back of its own deque and it takes them from the back again, idle workers
+ * steal from the front of other deques. Tasks spawned by other threads go
+ * to a shared injection deque.
+ *
+ * A thread waiting for a @ref task_group does not block while there is work
+ * to do, it executes queued tasks instead, so tasks can spawn and wait
+ * for other tasks. The thread calling wait also counts as one of the threads
+ * of the pool, so a pool with count() == 1 has no worker threads and
+ * everything is executed by the waiting thread.
+ *
+ * Tasks are plain structures pointing to a function and its data, so
+ * parallel_for and the for_each variants refer to the caller's function object
+ * on the stack and don't allocate; only spawn and post, which take ownership
+ * of a function object, allocate it.
+ *
+ * With wait_policy::spin, idle workers and waiting threads spin for a short
+ * time before going to sleep, and spawning or finishing a task only takes
+ * the pool mutex when some thread is asleep. This lowers the latency
+ * of short fork-join loops at the cost of some CPU time.
+ *
+ * Used internally by @ref parallel_foresighted_layout.
+ */
+class parallel {
 public:
-    parallel(unsigned count)
-            : m_bar(count) {
+    /// A set of spawned tasks that can be waited for.
+    /**
+     * Remembers the first exception thrown by its tasks, the rest are ignored.
+     */
+    class task_group {
+    public:
+        task_group() = default;
+        task_group(const task_group&) = delete;
+        task_group& operator=(const task_group&) = delete;
+
+    private:
+        friend class parallel;
+
+        std::atomic<unsigned> m_pending{ 0 };
+        std::mutex m_error_mutex;
+        std::exception_ptr m_error;
+
+        void fail(std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(m_error_mutex);
+            if (!m_error) {
+                m_error = std::move(error);
+            }
+        }
+    };
+
+    parallel(unsigned count, wait_policy policy = wait_policy::spin)
+            : m_policy(policy) {
         init(count);
     }
 
+    parallel(const parallel&) = delete;
+    parallel& operator=(const parallel&) = delete;
+
     ~parallel() { quit(); }
 
     /// Returns the number of threads.
     unsigned count() const { return m_threads.size() + 1; }
 
-    /// Assigns a job to a thread.
-    std::function<void()>& operator[](unsigned index) { return m_params[index].func; }
-    const std::function<void()>& operator[](unsigned index) const { return m_params[index].func; }
+    /// Returns how the threads wait, barriers used with this pool should do the same.
+    wait_policy policy() const { return m_policy; }
 
-    /// Performs assigned jobs and waits for them to complete.
-    void perform() {
-        {
+    /// Adds a task to the pool. Expected signature: void().
+    template<typename Func>
+    void spawn(task_group& group, Func func) {
+        ++group.m_pending;
+        push(owned_task(std::move(func), &group));
+    }
+
+    /// Adds a task that nobody waits for. Expected signature: void().
+    /**
+     * Exceptions thrown by the task are ignored. The task may own the last
+     * reference to the pool (e.g. through a shared pointer), the pool is then
+     * destroyed when the task finishes.
+     *
+     * Tasks that are still queued when the pool is destroyed are executed
+     * before the destructor returns, so nothing waiting for them hangs.
+     */
+    template<typename Func>
+    void post(Func func) {
+        push(owned_task(std::move(func), nullptr));
+    }
+
+    /// Waits until all tasks of a group are finished, executing queued tasks meanwhile.
+    /**
+     * @throw The first exception thrown by a task of the group.
+     */
+    void wait(task_group& group) {
+        unsigned self = current_index();
+        while (group.m_pending > 0) {
+            task t;
+            if (take(self, t)) {
+                execute(t);
+                continue;
+            }
+            sleep([&](){
+                return group.m_pending == 0 || m_queued > 0
+                        || (self != 0 && m_queues[self].pinned_count > 0);
+            });
+        }
+        if (group.m_error) {
+            std::exception_ptr error = std::move(group.m_error);
+            group.m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    /// Calls a function once for every thread index, each call on the thread of that index.
+    /**
+     * Unlike for_each, a call is never stolen by a different thread, so data
+     * touched by the call for a given index stays with the same thread (and, when
+     * the threads are pinned, the same CPU and NUMA node) across repeated calls.
+     * Index 0 is executed by the calling thread.
+     *
+     * Because a call can only run on its own thread, it waits until that thread
+     * finishes the task it is working on. In a pool shared with long posted jobs
+     * (e.g. executor::shared used by foresighted_layout::async), this can block
+     * for the whole duration of such a job.
+     *
+     * Expected Func signature: void(unsigned thread).
+     */
+    template<typename Func>
+    void for_each_pinned(const Func& func) {
+        task_group group;
+        for (unsigned i = 1; i < count(); ++i) {
+            auto& queue = m_queues[i];
+            ++group.m_pending;
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.pinned.push_back(task{ &call_index<Func>, erase(func), i, i + 1, &group });
+            }
+            ++queue.pinned_count;
+        }
+        if (m_sleeping > 0) {
+            // the specific threads have to wake up
             std::lock_guard<std::mutex> lock(m_mutex);
-            run_all();
+            m_wake.notify_all();
+        }
+        try {
+            func(0);
+        } catch (...) {
+            group.fail(std::current_exception());
+        }
+        wait(group);
+    }
+
+    /// Pins every worker thread to a different CPU, filling NUMA nodes one by one.
+    /**
+     * The calling thread, which has index 0, is not pinned.
+     * Only supported on Linux.
+     *
+     * @return False if some thread could not be pinned.
+     */
+    bool pin_threads() {
+        std::vector<unsigned> cpus = cpus_by_node();
+        if (cpus.empty()) {
+            return false;
         }
-        m_cv.notify_all();
-        // perform this threads function
-        if (m_params[0].func) {
-            m_params[0].func();
+        bool pinned = true;
+        for (unsigned i = 0; i < m_threads.size(); ++i) {
+            pinned = pin_thread(m_threads[i], cpus[(i + 1) % cpus.size()]) && pinned;
         }
-        // barrier till all threads have finished
-        m_bar.wait();
+        return pinned;
     }
 
-    /// Removes all assigned jobs from threads.
-    void clear() {
-        for (unsigned i = 0; i < count(); ++i) {
-            m_params[i].run = true;
+    /// Calls a function for subranges of [begin, end) in parallel.
+    /**
+     * The range is split in halves recursively until the parts are no larger
+     * than @p grain; the halves are spawned as tasks, so idle threads
+     * steal large parts of the range first.
+     *
+     * Expected signature: void(unsigned begin, unsigned end).
+     */
+    template<typename Func>
+    void parallel_for(unsigned begin, unsigned end, unsigned grain, const Func& func) {
+        if (begin >= end) {
+            return;
+        }
+        task_group group;
+        range_job<Func> job{ this, &func, std::max(grain, 1u), &group };
+        try {
+            job.split(begin, end);
+        } catch (...) {
+            group.fail(std::current_exception());
         }
+        // spawned tasks refer to 'func', so they have to finish before returning
+        wait(group);
+    }
+
+    /// Same as above, with a grain giving roughly four parts per thread.
+    template<typename Func>
+    void parallel_for(unsigned begin, unsigned end, const Func& func) {
+        unsigned size = end > begin ? end - begin : 0;
+        parallel_for(begin, end, default_grain(size), func);
     }
 
-    /// Assigns respective jobs to all threads and launches them.
+    /// Returns the grain used by parallel_for for a range of a given size.
+    unsigned default_grain(unsigned size) const {
+        return std::max(size / (count() * 4), 1u);
+    }
+
+    /// Calls a function once for every thread index in parallel.
     /**
+     * The calls can be executed by any thread, and not necessarily at the same time,
+     * so they must not wait for each other.
+     *
      * Expected Func signature: void(unsigned thread).
      */
     template<typename Func>
     void for_each(Func func) {
-        for (unsigned i = 0; i < count(); ++i) {
-            operator[](i) = [i, func](){
+        parallel_for(0, count(), 1, [&func](unsigned begin, unsigned end){
+            for (unsigned i = begin; i < end; ++i) {
                 func(i);
-            };
-        }
-        perform();
+            }
+        });
     }
 
-    /// Assigns respective jobs to all threads and launches them.
+    /// Splits a range of indices evenly between the threads and launches them.
     /**
-     * Also calculates appropriate indices to split the task evenly.
      * Expected signature: void(unsigned begin, unsigned end).
      */
     template<typename Func>
     void for_each(unsigned size, const Func& func) {
-        for (unsigned i = 0; i < count(); ++i) {
-            auto chunk = get_chunk(i, size);
-            operator[](i) = [&func, chunk](){
-                func(chunk.first, chunk.second);
-            };
-        }
-        perform();
+        for_each([&](unsigned thread){
+            auto chunk = get_chunk(thread, size);
+            func(chunk.first, chunk.second);
+        });
     }
 
-    /// Assigns respective jobs to all threads in an interleaved way and launches them.
+    /// Splits a range of indices between the threads in an interleaved way and launches them.
     /**
      * 'Interleaved way' meaning that if count() == 2
      * the two threads get (0, 2, 4, 6, 8) and (1, 3, 5, 7)
@@ -154,12 +492,9 @@ public:
      */
     template<typename Func>
     void for_each_interleaved(Func func) {
-        for (unsigned i = 0; i < count(); ++i) {
-            operator[](i) = [i, c = count(), func](){
-                func(i, c);
-            };
-        }
-        perform();
+        for_each([&func, c = count()](unsigned thread){
+            func(thread, c);
+        });
     }
 
     /// Returns beginning index and "past-the-end" index of a task chunk for a thread of given index.
@@ -180,32 +515,206 @@ public:
     }
 
 private:
+    // a function with its data and a range of indices to call it with
+    struct task {
+        void (*invoke)(void* data, unsigned begin, unsigned end) = nullptr;
+        void* data = nullptr;
+        unsigned begin = 0;
+        unsigned end = 0;
+        task_group* group = nullptr;
+    };
+
+    struct task_queue {
+        std::mutex mutex;
+        ring_buffer<task> tasks;
+        // tasks that only the owner of the queue can take
+        ring_buffer<task> pinned;
+        std::atomic<unsigned> pinned_count{ 0 };
+    };
+
+    // identifies the pool and the queue of the current thread
+    struct thread_info {
+        const parallel* pool = nullptr;
+        unsigned index = 0;
+    };
+
+    // the state of one parallel_for call, lives on the stack of the caller
+    template<typename Func>
+    struct range_job {
+        parallel* pool;
+        const Func* func;
+        unsigned grain;
+        task_group* group;
+
+        // spawns the upper halves and calls the function for what remains
+        void split(unsigned begin, unsigned end) {
+            while (end - begin > grain) {
+                unsigned middle = begin + (end - begin) / 2;
+                ++group->m_pending;
+                pool->push(task{ &range_job::run, this, middle, end, group });
+                end = middle;
+            }
+            (*func)(begin, end);
+        }
+
+        static void run(void* data, unsigned begin, unsigned end) {
+            static_cast<range_job*>(data)->split(begin, end);
+        }
+    };
+
+    static constexpr unsigned FairnessInterval = 16;
+
+    // queue 0 is the injection queue, queue i belongs to worker thread i
+    std::unique_ptr<task_queue[]> m_queues;
     std::vector<std::thread> m_threads;
-    std::unique_ptr<param[]> m_params;
-    bool m_end{ false };
+    std::atomic<int> m_queued{ 0 };
+    std::atomic<unsigned> m_sleeping{ 0 };
+    std::atomic<bool> m_end{ false };
+    wait_policy m_policy;
     std::mutex m_mutex;
-    std::condition_variable m_cv;
-    barrier m_bar{ 0 };
+    std::condition_variable m_wake;
 
-    void thread_func(param* p) {
-        while (true) {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            m_cv.wait(lock, [&](){ return p->run; });
-            p->run = false;
-            lock.unlock();
-            if (m_end) {
-                break;
+    static thread_info& current_thread() {
+        static thread_local thread_info info;
+        return info;
+    }
+
+    unsigned current_index() const {
+        const auto& info = current_thread();
+        return info.pool == this ? info.index : 0;
+    }
+
+    template<typename Func>
+    static void* erase(const Func& func) {
+        return const_cast<void*>(static_cast<const void*>(&func));
+    }
+
+    template<typename Func>
+    static void call_index(void* data, unsigned begin, unsigned) {
+        (*static_cast<const Func*>(data))(begin);
+    }
+
+    template<typename Func>
+    static void call_owned(void* data, unsigned, unsigned) {
+        // deleted even if it throws
+        std::unique_ptr<Func> func(static_cast<Func*>(data));
+        (*func)();
+    }
+
+    template<typename Func>
+    static task owned_task(Func func, task_group* group) {
+        return task{ &call_owned<Func>, new Func(std::move(func)), 0, 0, group };
+    }
+
+    // adds a task to the queue of the current thread
+    void push(const task& t) {
+        auto& queue = m_queues[current_index()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(t);
+        }
+        ++m_queued;
+        if (m_sleeping > 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wake.notify_one();
+        }
+    }
+
+    bool pop(task_queue& queue, task& t, bool back) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        t = back ? queue.tasks.pop_back() : queue.tasks.pop_front();
+        --m_queued;
+        return true;
+    }
+
+    // takes a task from the back of its own queue or steals one from the front of another;
+    // the injection queue is always taken from the front, so concurrent callers
+    // are served in the order they came
+    bool take(unsigned self, task& t, bool injection_first = false) {
+        if (self != 0 && m_queues[self].pinned_count > 0) {
+            auto& own = m_queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            t = own.pinned.pop_front();
+            --own.pinned_count;
+            return true;
+        }
+        if (m_queued <= 0) {
+            return false;
+        }
+        if (injection_first && self != 0 && pop(m_queues[0], t, false)) {
+            return true;
+        }
+        if (pop(m_queues[self], t, self != 0)) {
+            return true;
+        }
+        for (unsigned i = 1; i < count(); ++i) {
+            if (pop(m_queues[(self + i) % count()], t, false)) {
+                return true;
             }
-            if (p->func) {
-                p->func();
+        }
+        return false;
+    }
+
+    void execute(task& t) {
+        task_group* group = t.group;
+        try {
+            t.invoke(t.data, t.begin, t.end);
+        } catch (...) {
+            if (group) {
+                group->fail(std::current_exception());
             }
-            m_bar.wait();
+        }
+        if (!group) {
+            // destroying a posted task may have destroyed the pool, see quit
+            return;
+        }
+        // the group must not be touched after this, its owner may have returned
+        if (--group->m_pending == 0 && m_sleeping > 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wake.notify_all();
         }
     }
 
-    void run_all() {
-        for (unsigned i = 0; i < count(); ++i) {
-            m_params[i].run = true;
+    // waits until there may be something to do
+    template<typename Predicate>
+    void sleep(Predicate predicate) {
+        if (spin_until(m_policy, predicate)) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // counted before the predicate is checked, so whoever changes it
+        // after the check sees a sleeping thread and notifies
+        ++m_sleeping;
+        m_wake.wait(lock, predicate);
+        --m_sleeping;
+    }
+
+    void thread_func(unsigned index) {
+        current_thread() = { this, index };
+        unsigned executed = 0;
+        while (true) {
+            task t;
+            // every few tasks new jobs are preferred to the own queue,
+            // so a large job can't starve the jobs of other callers
+            if (take(index, t, executed % FairnessInterval == 0)) {
+                execute(t);
+                if (current_thread().pool != this) {
+                    // the pool has been destroyed by the task
+                    return;
+                }
+                ++executed;
+                continue;
+            }
+            sleep([this, index](){
+                return m_end || m_queued > 0 || m_queues[index].pinned_count > 0;
+            });
+            // queued tasks are finished first, nobody else would run posted ones
+            if (m_end && m_queued <= 0) {
+                break;
+            }
         }
     }
 
@@ -213,26 +722,36 @@ private:
         if (count == 0) {
             throw std::invalid_argument("initializing 0 threads");
         }
-        m_threads.clear();
-        m_bar.reset(count);
-        m_params = std::make_unique<param[]>(count);
+        m_queues = std::make_unique<task_queue[]>(count);
         m_threads.reserve(count - 1);
         for (unsigned i = 1; i < count; ++i) {
-            std::thread th(&parallel::thread_func, this, &m_params[i]);
-            m_threads.emplace_back(std::move(th));
+            m_threads.emplace_back(&parallel::thread_func, this, i);
         }
     }
 
-    // turns off all threads
+    // turns off all threads once the queued tasks are done
     void quit() {
         {
             std::lock_guard<std::mutex> lock(m_mutex);
             m_end = true;
-            run_all();
         }
-        m_cv.notify_all();
+        m_wake.notify_all();
         for (auto& th : m_threads) {
-            th.join();
+            if (th.get_id() == std::this_thread::get_id()) {
+                // a posted task held the last reference to this pool,
+                // its thread must not touch the pool anymore
+                current_thread().pool = nullptr;
+                th.detach();
+            } else {
+                th.join();
+            }
+        }
+        // without worker threads (or after a task posted the last one) the tasks
+        // are left to this thread
+        unsigned self = current_index();
+        task t;
+        while (take(self, t)) {
+            execute(t);
         }
     }
 };
@@ -0,0 +1,208 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains the quantized output mode, which writes node positions
+ * as integer coordinates of a fixed grid covering the canvas instead of
+ * decimal numbers.
+ *
+ * @sa quantization,
+ * write_quantized
+ */
+#pragma once
+
+#include "dynamic_graph.h"
+#include "coords.h"
+
+#include <ostream>
+#include <string>
+#include <cstdint>
+#include <cmath> // std::lround
+#include <algorithm> // std::min, std::max
+#include <stdexcept>
+
+namespace dyng {
+
+/// Integer coordinates of a grid cell.
+struct grid_coords {
+    std::uint32_t x = 0;
+    std::uint32_t y = 0;
+};
+
+/// Maps positions on a canvas to a grid of 2^bits x 2^bits cells.
+/**
+ * The canvas is given the same way as in foresighted_layout::set_canvas,
+ * so the grid spans [x - w/2, x + w/2] and [y - h/2, y + h/2].
+ * Cell (0, 0) is at (x - w/2, y - h/2).
+ *
+ * For example, using the canvas dimensions of a layout:
+ *
+ *     dyng::quantization q(12, layout.canvas_width(), layout.canvas_height(), layout.center());
+ *
+ * @sa write_quantized,
+ * archive_writer::set_quantization
+ */
+class quantization {
+public:
+    /// Creates a disabled quantization (positions are kept as they are).
+    quantization() = default;
+
+    /**
+     * @param bits The number of bits per axis, between 1 and 24.
+     * @throw std::invalid_argument If @p bits is out of range or the canvas is empty.
+     */
+    quantization(unsigned bits, float canvas_width, float canvas_height, coords center = coords())
+            : m_bits(bits)
+            , m_width(canvas_width)
+            , m_height(canvas_height)
+            , m_center(center) {
+        if (bits < 1 || bits > MaxBits) {
+            throw std::invalid_argument("quantization bits have to be between 1 and 24");
+        }
+        if (!(canvas_width > 0) || !(canvas_height > 0)) {
+            throw std::invalid_argument("empty canvas");
+        }
+    }
+
+    /// Returns false for a default constructed object.
+    bool enabled() const { return m_bits != 0; }
+
+    unsigned bits() const { return m_bits; }
+    float canvas_width() const { return m_width; }
+    float canvas_height() const { return m_height; }
+    coords center() const { return m_center; }
+
+    /// Returns the largest grid coordinate.
+    std::uint32_t max_value() const { return (std::uint32_t(1) << m_bits) - 1; }
+
+    /// Returns the grid cell of a position, positions outside the canvas are clamped.
+    grid_coords quantize(coords pos) const {
+        return { axis(pos.x, m_center.x, m_width), axis(pos.y, m_center.y, m_height) };
+    }
+
+    /// Returns the position on the canvas corresponding to a grid cell.
+    coords restore(grid_coords cell) const {
+        float max = max_value();
+        return { m_center.x - m_width * 0.5f + cell.x / max * m_width,
+                m_center.y - m_height * 0.5f + cell.y / max * m_height };
+    }
+
+private:
+    static constexpr unsigned MaxBits = 24;
+
+    unsigned m_bits = 0;
+    float m_width = 1;
+    float m_height = 1;
+    coords m_center;
+
+    std::uint32_t axis(float value, float center, float size) const {
+        float relative = (value - (center - size * 0.5f)) / size;
+        relative = std::min(1.0f, std::max(0.0f, relative));
+        return static_cast<std::uint32_t>(std::lround(relative * max_value()));
+    }
+};
+
+
+namespace detail {
+
+constexpr std::size_t QuantizedFlushSize = 1 << 16;
+
+// appends decimal digits without going through a stream
+inline void append_uint(std::string& buf, std::uint32_t value) {
+    char digits[10];
+    unsigned count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        buf += digits[--count];
+    }
+}
+
+/// Appends a state in the text format with quantized positions.
+inline void append_quantized(std::string& buf, const graph_state& state, const quantization& q) {
+    buf += "[\n";
+    for (const auto& n : state.nodes()) {
+        grid_coords cell = q.quantize(n.pos());
+        buf += "n ";
+        append_uint(buf, n.id().value);
+        buf += ' ';
+        append_uint(buf, cell.x);
+        buf += ' ';
+        append_uint(buf, cell.y);
+        buf += ";\n";
+    }
+    for (const auto& e : state.edges()) {
+        buf += "e ";
+        append_uint(buf, e.id().value);
+        buf += ' ';
+        append_uint(buf, e.one_id().value);
+        buf += ' ';
+        append_uint(buf, e.two_id().value);
+        buf += ";\n";
+    }
+    buf += "]\n";
+}
+
+} // namespace detail
+
+
+/// Writes a graph state in the text format with positions replaced by grid coordinates.
+/**
+ * The output can be read by the usual operator>>, the coordinates are then
+ * the integer grid coordinates. Use restore_positions to map them back
+ * to the canvas.
+ */
+inline void write_quantized(std::ostream& out, const graph_state& state, const quantization& q) {
+    std::string buf;
+    detail::append_quantized(buf, state, q);
+    out.write(buf.data(), buf.size());
+}
+
+/// Maps grid coordinates read from quantized output back to positions on the canvas.
+/**
+ * Positions are only as precise as the grid of @p q.
+ *
+ * @sa write_quantized
+ */
+inline void restore_positions(graph_state& state, const quantization& q) {
+    for (auto& n : state.nodes()) {
+        n.pos() = q.restore({ static_cast<std::uint32_t>(n.pos().x),
+                static_cast<std::uint32_t>(n.pos().y) });
+    }
+}
+
+/// Writes a dynamic graph in the text format with positions replaced by grid coordinates.
+/**
+ * @sa write_quantized(std::ostream&, const graph_state&, const quantization&)
+ */
+inline void write_quantized(std::ostream& out, const dynamic_graph& dgraph, const quantization& q) {
+    std::string buf = "{\n";
+    for (const auto& state : dgraph.states()) {
+        detail::append_quantized(buf, state, q);
+        // flush regularly so the buffer doesn't grow with the whole graph
+        if (buf.size() > detail::QuantizedFlushSize) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    buf += "}\n";
+    out.write(buf.data(), buf.size());
+}
+
+} // namespace dyng
@@ -0,0 +1,180 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "parallel.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <memory> // std::unique_ptr
+#include <chrono>
+#include <initializer_list>
+#include <algorithm> // std::min, std::max
+#include <utility> // std::move, std::pair
+#include <stdexcept>
+
+namespace dyng {
+
+/// The time spent in one stage of a computation.
+/**
+ * @sa foresighted_layout::stage_timings
+ */
+struct stage_timing {
+    std::string name;
+    /// Wall time from the start of the first task of the stage to the end of the last one, in seconds.
+    /**
+     * Tasks of a stage running in parallel are counted once, so the times
+     * of all stages are comparable.
+     */
+    double seconds = 0;
+    /// The number of tasks the stage was split into.
+    unsigned tasks = 0;
+};
+
+
+namespace detail {
+
+/// A set of tasks with dependencies between them.
+/**
+ * A task can only depend on tasks added before it, so the graph is always
+ * acyclic and the order of adding is a valid sequential order.
+ * When run on a pool, every task is spawned as soon as all its dependencies
+ * have finished, so independent tasks overlap.
+ *
+ * Tasks with the same name form a stage; the time spent in every stage is measured.
+ */
+class task_graph {
+public:
+    using task_id = unsigned;
+
+    /// Adds a task and returns its identifier, to be used in dependencies of later tasks.
+    /**
+     * @throw std::invalid_argument If a dependency does not exist yet.
+     */
+    task_id add(std::string name
+            , std::function<void()> func
+            , std::initializer_list<task_id> dependencies = {}) {
+        task_id id = m_tasks.size();
+        for (task_id dep : dependencies) {
+            if (dep >= id) {
+                throw std::invalid_argument("dependency on a task that doesn't exist yet");
+            }
+            m_tasks[dep].successors.push_back(id);
+        }
+        task t;
+        t.name = std::move(name);
+        t.func = std::move(func);
+        t.dependencies = dependencies.size();
+        m_tasks.push_back(std::move(t));
+        return id;
+    }
+
+    /// Returns the number of tasks.
+    unsigned size() const { return m_tasks.size(); }
+
+    /// Runs all tasks, in parallel on @p pool, or sequentially if it is null.
+    /**
+     * @throw The first exception thrown by a task; tasks depending on it are not run.
+     */
+    void run(parallel* pool) {
+        if (pool == nullptr || pool->count() == 1) {
+            for (auto& t : m_tasks) {
+                execute(t);
+            }
+            return;
+        }
+        m_remaining = std::make_unique<std::atomic<unsigned>[]>(m_tasks.size());
+        for (unsigned i = 0; i < m_tasks.size(); ++i) {
+            m_remaining[i] = m_tasks[i].dependencies;
+        }
+        parallel::task_group group;
+        for (unsigned i = 0; i < m_tasks.size(); ++i) {
+            if (m_tasks[i].dependencies == 0) {
+                spawn(*pool, group, i);
+            }
+        }
+        pool->wait(group);
+    }
+
+    /// Returns the measured time of every stage, in the order the stages were added.
+    std::vector<stage_timing> timings() const {
+        std::vector<stage_timing> result;
+        // the span of the executed tasks of every stage
+        std::vector<std::pair<clock::time_point, clock::time_point>> spans;
+        for (const auto& t : m_tasks) {
+            auto found = result.begin();
+            while (found != result.end() && found->name != t.name) {
+                ++found;
+            }
+            if (found == result.end()) {
+                result.push_back(stage_timing{ t.name, 0, 0 });
+                spans.emplace_back(clock::time_point::max(), clock::time_point::min());
+                found = result.end() - 1;
+            }
+            ++found->tasks;
+            if (t.executed) {
+                auto& span = spans[found - result.begin()];
+                span.first = std::min(span.first, t.start);
+                span.second = std::max(span.second, t.end);
+                std::chrono::duration<double> elapsed = span.second - span.first;
+                found->seconds = elapsed.count();
+            }
+        }
+        return result;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct task {
+        std::string name;
+        std::function<void()> func;
+        unsigned dependencies = 0;
+        std::vector<task_id> successors;
+        bool executed = false;
+        clock::time_point start;
+        clock::time_point end;
+    };
+
+    std::vector<task> m_tasks;
+    std::unique_ptr<std::atomic<unsigned>[]> m_remaining;
+
+    void execute(task& t) {
+        t.start = clock::now();
+        t.func();
+        t.end = clock::now();
+        t.executed = true;
+    }
+
+    void spawn(parallel& pool, parallel::task_group& group, task_id id) {
+        pool.spawn(group, [this, &pool, &group, id](){
+            task& t = m_tasks[id];
+            // if this throws, the successors are never released
+            execute(t);
+            for (task_id next : t.successors) {
+                if (--m_remaining[next] == 0) {
+                    spawn(pool, group, next);
+                }
+            }
+        });
+    }
+};
+
+} // namespace detail
+
+} // namespace dyng
@@ -0,0 +1,188 @@
+/*
+   Copyright 2020 František Bráblík
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/**
+ * @file
+ *
+ * This file contains an observer that records a timeline of a layout
+ * computation and writes it in the Chrome trace-event format.
+ *
+ * @sa trace_recorder
+ */
+#pragma once
+
+#include "observer.h"
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory> // std::shared_ptr
+#include <ostream>
+#include <iomanip> // std::setprecision
+#include <thread>
+#include <cstdint>
+
+namespace dyng {
+
+/// Observer that records the spans of phases on every thread.
+/**
+ * Every thread appends to its own buffer, so recording doesn't take any lock
+ * after the first event of a thread. The timeline can be written with
+ * write_chrome_trace and viewed in Perfetto or chrome://tracing; the threads
+ * are shown as separate tracks, so idle time at the end of tolerance rounds
+ * (threads waiting for the slowest one) and the sequential acceptance
+ * are clearly visible.
+ *
+ * Copies share the same recording. The recording must not be written or
+ * cleared while a layout using the recorder is running.
+ *
+ * For example:
+ *
+ *     dyng::trace_recorder trace;
+ *     dyng::parallel_foresighted_layout<
+ *             dyng::fruchterman_reingold<dyng::initial_placement, dyng::trace_recorder>,
+ *             dyng::trace_recorder> layout(4, 0.04);
+ *     layout.set_observer(trace);
+ *     layout.static_layout().set_observer(trace);
+ *     layout(dgraph);
+ *     std::ofstream file("trace.json");
+ *     trace.write_chrome_trace(file);
+ */
+class trace_recorder {
+public:
+    static constexpr bool enabled = true;
+    static constexpr bool samples_iterations = false;
+
+    trace_recorder()
+            : m_state(std::make_shared<state>()) {}
+
+    void begin(layout_phase) {}
+
+    void end(layout_phase p, double seconds, unsigned item) {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::micro> since_start = now - m_state->start;
+        double duration = seconds * 1e6;
+        buffer().push_back(span{ p, item, since_start.count() - duration, duration });
+    }
+
+    void count(layout_counter, std::uint64_t) {}
+
+    void sample(const iteration_sample&) {}
+
+    /// Returns the number of recorded spans.
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        std::size_t result = 0;
+        for (const auto& t : m_state->threads) {
+            result += t.spans.size();
+        }
+        return result;
+    }
+
+    /// Removes all recorded spans.
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        for (auto& t : m_state->threads) {
+            t.spans.clear();
+        }
+    }
+
+    /// Writes the recording as a JSON object in the Chrome trace-event format.
+    void write_chrome_trace(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        auto flags = out.flags();
+        auto precision = out.precision();
+        out << std::fixed << std::setprecision(3);
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        auto separator = [&](){
+            out << (first ? "\n" : ",\n");
+            first = false;
+        };
+        for (unsigned tid = 0; tid < m_state->threads.size(); ++tid) {
+            separator();
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                    << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+            for (const auto& s : m_state->threads[tid].spans) {
+                separator();
+                out << "{\"name\":\"" << phase_name(s.p) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                        << tid << ",\"ts\":" << s.start << ",\"dur\":" << s.duration
+                        << ",\"args\":{\"item\":" << s.item << "}}";
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    struct span {
+        layout_phase p;
+        unsigned item;
+        // microseconds since the creation of the recorder
+        double start;
+        double duration;
+    };
+
+    struct thread_spans {
+        std::thread::id thread;
+        std::vector<span> spans;
+    };
+
+    struct state {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        // identifies this recording in the caches of threads, addresses can be reused
+        std::uint64_t id = next_id()++;
+        mutable std::mutex mutex;
+        // a deque, so that the buffers don't move when a thread is added
+        std::deque<thread_spans> threads;
+    };
+
+    std::shared_ptr<state> m_state;
+
+    static std::atomic<std::uint64_t>& next_id() {
+        static std::atomic<std::uint64_t> id{ 1 };
+        return id;
+    }
+
+    // returns the buffer of the calling thread, registers it on first use
+    std::vector<span>& buffer() {
+        struct cached {
+            std::uint64_t id = 0;
+            std::vector<span>* spans = nullptr;
+        };
+        thread_local cached cache;
+        if (cache.id != m_state->id) {
+            // the thread may have used this recording before another one
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            auto self = std::this_thread::get_id();
+            auto found = m_state->threads.begin();
+            while (found != m_state->threads.end() && found->thread != self) {
+                ++found;
+            }
+            if (found == m_state->threads.end()) {
+                m_state->threads.push_back(thread_spans{ self, {} });
+                found = m_state->threads.end() - 1;
+            }
+            cache.id = m_state->id;
+            cache.spans = &found->spans;
+        }
+        return *cache.spans;
+    }
+};
+
+} // namespace dyng
@@ -1,3 +1,8 @@
 #define CATCH_CONFIG_MAIN
 
 #include "catch2/catch.hpp"
+
+#include "../demo/headers/allocation_counter.h"
+
+// counts allocations of the whole test program, see the test "steady-state allocations"
+DEMO_DEFINE_ALLOCATION_COUNTER